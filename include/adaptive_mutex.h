@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace omega
+{
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Stripe mutex for critical sections of tens of nanoseconds. A contended lock() spins on the state
+// with exponentially growing pause runs first and sleeps in futex only when the owner keeps it longer.
+// The spin budget follows the waits which ended while spinning, so stripes with long hold times park
+// early and short ones rarely reach the kernel. Each mutex owns a cache line, the lock word is 4 bytes
+class alignas(64) adaptive_mutex
+{
+    constexpr static std::uint32_t UNLOCKED = 0;
+    constexpr static std::uint32_t LOCKED = 1;
+    // Locked and a waiter may sleep in futex, unlock() has to wake one
+    constexpr static std::uint32_t PARKED = 2;
+    constexpr static std::uint32_t MIN_SPIN = 16;
+    constexpr static std::uint32_t MAX_SPIN = 1024;
+    constexpr static std::uint32_t MAX_BACKOFF = 64;
+
+    std::atomic<std::uint32_t> m_state{UNLOCKED};
+    // Pauses a successful spin took on average, only a hint so races on it are harmless
+    std::atomic<std::uint32_t> m_spin_estimate{MIN_SPIN};
+
+    void futex(int operation, std::uint32_t value)
+    {
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_state), operation | FUTEX_PRIVATE_FLAG, value,
+                  nullptr, nullptr, 0);
+    }
+
+    bool spin()
+    {
+        std::uint32_t const estimate = m_spin_estimate.load(std::memory_order_relaxed);
+        std::uint32_t const limit = std::min(MAX_SPIN, 2 * estimate + MIN_SPIN);
+        std::uint32_t spent = 0;
+        for (std::uint32_t backoff = 1; spent < limit; backoff = std::min(2 * backoff, MAX_BACKOFF))
+        {
+            for (std::uint32_t i = 0; i < backoff; ++i)
+            {
+                cpu_relax();
+            }
+            spent += backoff;
+
+            // Reading first keeps the cache line shared until the owner releases it
+            if (m_state.load(std::memory_order_relaxed) == UNLOCKED && try_lock())
+            {
+                m_spin_estimate.store(std::uint32_t(std::int64_t(estimate) + (std::int64_t(spent) - std::int64_t(estimate)) / 8),
+                                      std::memory_order_relaxed);
+                return true;
+            }
+        }
+        m_spin_estimate.store(std::max(MIN_SPIN, estimate - estimate / 8), std::memory_order_relaxed);
+        return false;
+    }
+
+public:
+    adaptive_mutex()=default;
+    adaptive_mutex(adaptive_mutex const& other)=delete;
+    adaptive_mutex& operator=(adaptive_mutex const& other)=delete;
+
+    bool try_lock()
+    {
+        std::uint32_t expected = UNLOCKED;
+        return m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void lock()
+    {
+        if (try_lock() || spin())
+            return;
+
+        // Whoever takes the lock from here on marks it parked, since other sleepers may remain
+        while (m_state.exchange(PARKED, std::memory_order_acquire) != UNLOCKED)
+        {
+            futex(FUTEX_WAIT, PARKED);
+        }
+    }
+
+    void unlock()
+    {
+        if (m_state.exchange(UNLOCKED, std::memory_order_release) == PARKED)
+            futex(FUTEX_WAKE, 1);
+    }
+};
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "snapshot.h"
+
+namespace omega
+{
+// Specialize for key or value types which are neither arithmetic nor std::string
+template<typename T, typename Enable = void>
+struct text_parser;
+
+template<typename T>
+struct text_parser<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+{
+    static bool parse(std::string_view text, T& value)
+    {
+        auto const result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc{} && result.ptr == text.data() + text.size();
+    }
+};
+
+template<>
+struct text_parser<std::string>
+{
+    static bool parse(std::string_view text, std::string& value)
+    {
+        value.assign(text.data(), text.size());
+        return true;
+    }
+};
+
+struct import_options
+{
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    // Records parsed per chunk. Their entries reach add_or_update_batch split by key partition, every
+    // stripe mutex is taken once per batch
+    std::size_t batch_size = 4096;
+};
+
+struct import_result
+{
+    std::uint64_t records;
+    std::uint64_t malformed;
+};
+
+namespace detail
+{
+// Splits [0, size) into chunk_count chunks parsed by options.threads workers, parse(first, last, add) calls
+// add(entry) for every record and returns the number of malformed records. Entries are sorted into a batch
+// per partition of the key hashes, a chunk applies its batch of a partition only after the chunk before it
+// applied its own. A key repeated in the file so ends up with the value of its last record, whichever
+// worker parsed it, while the partitions load concurrently
+template<typename Table, typename ParseFunc>
+import_result parallel_import(Table& table, std::size_t size, std::size_t chunk_count, import_options const& options,
+                              ParseFunc parse)
+{
+    using entry_type = std::pair<typename Table::key_type, typename Table::mapped_type>;
+    std::size_t const workers = std::max<std::size_t>(std::min(options.threads, chunk_count), 1);
+    // The next chunk to apply its batch of each partition
+    std::unique_ptr<std::atomic<std::size_t>[]> turns{new std::atomic<std::size_t>[workers]{}};
+    std::atomic<std::size_t> next_chunk{0};
+    std::atomic<std::uint64_t> records{0};
+    std::atomic<std::uint64_t> malformed{0};
+    // Set when a worker throws, the others stop instead of waiting for its turn forever
+    std::atomic<bool> failed{false};
+    run_snapshot_workers(workers, [&]()
+    {
+        std::vector<std::vector<entry_type>> batches(workers);
+        typename Table::hasher hasher;
+        auto add = [&batches, &hasher, workers](entry_type&& entry)
+        {
+            batches[hasher(entry.first) % workers].push_back(std::move(entry));
+        };
+
+        try
+        {
+            for(;;)
+            {
+                std::size_t const chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= chunk_count)
+                    break;
+
+                std::size_t const first = std::size_t(std::uint64_t(size) * chunk / chunk_count);
+                std::size_t const last = std::size_t(std::uint64_t(size) * (chunk + 1) / chunk_count);
+                malformed.fetch_add(parse(first, last, add), std::memory_order_relaxed);
+
+                // Starting at a different partition per chunk lets consecutive chunks apply side by side
+                for (std::size_t i = 0; i < workers; ++i)
+                {
+                    std::size_t const partition = (chunk + i) % workers;
+                    while (turns[partition].load(std::memory_order_acquire) != chunk)
+                    {
+                        if (failed.load(std::memory_order_relaxed))
+                            return;
+                        std::this_thread::yield();
+                    }
+
+                    auto& batch = batches[partition];
+                    if (!batch.empty())
+                    {
+                        table.add_or_update_batch(batch);
+                        records.fetch_add(batch.size(), std::memory_order_relaxed);
+                        batch.clear();
+                    }
+                    turns[partition].store(chunk + 1, std::memory_order_release);
+                }
+            }
+        }
+        catch (...)
+        {
+            failed.store(true, std::memory_order_relaxed);
+            throw;
+        }
+    });
+
+    return import_result{records.load(), malformed.load()};
+}
+
+// Enough chunks to keep every worker busy, each holding about batch_size records
+inline std::size_t import_chunks(std::size_t records, import_options const& options)
+{
+    std::size_t const batch_size = std::max<std::size_t>(options.batch_size, 1);
+    return std::max<std::size_t>({4 * options.threads, (records + batch_size - 1) / batch_size, 1});
+}
+}
+
+// Imports a file of fixed size records: raw Key bytes followed by raw Value bytes
+template<typename Table>
+import_result import_binary(Table& table, std::string const& path, import_options options = {})
+{
+    using key_type = typename Table::key_type;
+    using value_type = typename Table::mapped_type;
+    static_assert(std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>,
+                  "binary import requires trivially copyable keys and values");
+    constexpr std::size_t record_size = sizeof(key_type) + sizeof(value_type);
+
+    mapped_file file{path};
+    std::size_t const record_count = file.size() / record_size;
+    table.reserve(record_count);
+
+    auto result = detail::parallel_import(table, record_count, detail::import_chunks(record_count, options), options,
+        [&file](std::size_t first, std::size_t last, auto& add)
+        {
+            for (std::size_t i = first; i < last; ++i)
+            {
+                char const* const record = file.data() + i * record_size;
+                std::pair<key_type, value_type> entry;
+                std::memcpy(&entry.first, record, sizeof(key_type));
+                std::memcpy(&entry.second, record + sizeof(key_type), sizeof(value_type));
+                add(std::move(entry));
+            }
+            return std::uint64_t(0);
+        });
+
+    result.malformed = file.size() % record_size != 0 ? 1 : 0;
+    return result;
+}
+
+// Imports lines of "key<delimiter>value". Chunks start after the first line break inside them, a line
+// belongs to the chunk it starts in. Lines which do not parse are skipped and counted as malformed
+template<typename Table>
+import_result import_delimited(Table& table, std::string const& path, char delimiter = ',', import_options options = {})
+{
+    using key_type = typename Table::key_type;
+    using value_type = typename Table::mapped_type;
+
+    mapped_file file{path};
+    char const* const data = file.data();
+    std::size_t const size = file.size();
+
+    // Estimates the line count from the first 64KiB to reserve buckets up front
+    std::size_t const sample_size = std::min<std::size_t>(size, 64 << 10);
+    std::size_t const sample_lines = std::count(data, data + sample_size, '\n');
+    std::size_t const lines = sample_lines > 0 ? size / std::max<std::size_t>(sample_size / sample_lines, 1) : 0;
+    if (lines > 0)
+        table.reserve(lines);
+
+    return detail::parallel_import(table, size, detail::import_chunks(lines, options), options,
+        [data, size, delimiter](std::size_t first, std::size_t last, auto& add)
+        {
+            std::uint64_t malformed = 0;
+            std::size_t position = first;
+            if (position > 0 && data[position - 1] != '\n')
+            {
+                char const* const line_break = static_cast<char const*>(std::memchr(data + position, '\n', size - position));
+                position = line_break ? std::size_t(line_break - data) + 1 : size;
+            }
+
+            while (position < last)
+            {
+                char const* const line_break = static_cast<char const*>(std::memchr(data + position, '\n', size - position));
+                std::size_t const line_end = line_break ? std::size_t(line_break - data) : size;
+                std::string_view line{data + position, line_end - position};
+                position = line_end + 1;
+
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+                if (line.empty())
+                    continue;
+
+                std::size_t const separator = line.find(delimiter);
+                std::pair<key_type, value_type> entry;
+                if (separator == std::string_view::npos ||
+                    !text_parser<key_type>::parse(line.substr(0, separator), entry.first) ||
+                    !text_parser<value_type>::parse(line.substr(separator + 1), entry.second))
+                {
+                    ++malformed;
+                    continue;
+                }
+
+                add(std::move(entry));
+            }
+
+            return malformed;
+        });
+}
+}
@@ -7,22 +7,40 @@
 #include <optional>
 #include <vector>
 #include <list>
+#include <map>
 #include <utility>
 #include <algorithm>
 #include <cmath>
+#include <future>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+#include "adaptive_mutex.h"
+#include "hot_keys.h"
+#include "lock_stats.h"
+#include "mapped_lookup_table.h"
+#include "mcs_mutex.h"
+#include "mutation_log.h"
+#include "snapshot.h"
+#include "table_metrics.h"
+#include "table_telemetry.h"
+#include "tracer.h"
+#include "workload_trace.h"
 
 namespace omega
 {
+template<typename Mutex = std::mutex>
 class multiple_lock
 {
-    std::vector<std::unique_lock<std::mutex>> m_locks;
+    std::vector<std::unique_lock<Mutex>> m_locks;
 public:
-    multiple_lock(std::vector<std::mutex>& locks)
+    multiple_lock(std::vector<Mutex>& locks)
     {
         m_locks.resize(locks.size());
 	    for (int i = 0; i < locks.size(); ++i)
 	    {
-            m_locks[i] = std::unique_lock<std::mutex>(locks[i], std::defer_lock_t{});
+            m_locks[i] = std::unique_lock<Mutex>(locks[i], std::defer_lock_t{});
         }
 
         int idx = 0;
@@ -53,7 +71,39 @@ public:
     }
 };
 
-template<typename Key, typename Value, std::size_t MaxLoadFactor = 4, typename Hash=std::hash<Key>>
+// A table resizes as soon as one bucket holds more than max_load_factor entries. With uniformly hashed
+// keys chain lengths are Poisson distributed, this is the expected number of such buckets
+inline double overflowing_buckets(double entries, double buckets, std::size_t max_load_factor)
+{
+    double const load = entries / buckets;
+    double term = std::exp(-load);
+    double at_most = term;
+    for (std::size_t length = 1; length <= max_load_factor; ++length)
+    {
+        term *= load / double(length);
+        at_most += term;
+    }
+    return buckets * std::max(0.0, 1.0 - at_most);
+}
+
+// Bucket count reserved for the entries. Starts from an average chain of max_load_factor / 2 and grows
+// while a resize is expected, but never past an average chain of max_load_factor / 4: keeping every
+// chain of a large table short takes many times the memory, an occasional resize is cheaper
+inline std::size_t reserve_capacity(std::size_t entries, std::size_t max_load_factor)
+{
+    max_load_factor = std::max<std::size_t>(max_load_factor, 1);
+    std::size_t const limit = 4 * entries / max_load_factor + 1;
+    std::size_t capacity = 2 * entries / max_load_factor + 1;
+    while (capacity < limit && overflowing_buckets(double(entries), double(capacity), max_load_factor) > 0.01)
+    {
+        capacity += capacity / 8 + 1;
+    }
+    return std::min(capacity, limit);
+}
+
+// Mutex guards a stripe, any Lockable works: std::mutex, omega::adaptive_mutex, omega::mcs_mutex
+template<typename Key, typename Value, std::size_t MaxLoadFactor = 4, typename Hash=std::hash<Key>, typename Tracer = null_tracer,
+         typename Mutex = std::mutex>
 class concurrent_lookup_table
 {
 private:
@@ -66,12 +116,25 @@ private:
         bucket_data m_data;
         std::size_t m_size;
 
+        template<typename Iterator>
+        static Iterator find_entry(Iterator first, Iterator last, Key const& key)
+        {
+            std::size_t length = 0;
+            for (; first != last; ++first)
+            {
+                ++length;
+                if (first->first == key)
+                    break;
+            }
+
+            Tracer::probed(length);
+            return first;
+        }
+
     public:
         bucket_iterator find_entry(Key const& key)
         {
-            return std::find_if(m_data.begin(), m_data.end(),
-                                [&key](bucket_value const& item)
-                                { return item.first == key; });
+            return find_entry(m_data.begin(), m_data.end(), key);
         }
 
         const bucket_data& get_data() const
@@ -79,11 +142,14 @@ private:
             return m_data;
         }
 
+        bucket_data& get_data()
+        {
+            return m_data;
+        }
+
         const_bucket_iterator find_entry(Key const& key) const
         {
-            return std::find_if(m_data.cbegin(), m_data.cend(),
-                                [&key](bucket_value const& item)
-                                { return item.first == key; });
+            return find_entry(m_data.cbegin(), m_data.cend(), key);
         }
 
         std::optional<Value> get_value(Key const& key) const
@@ -92,14 +158,17 @@ private:
             return (found_entry != m_data.cend()) ? std::make_optional(found_entry->second) : std::optional<Value>{};
         }
 
-        void remove(Key const& key)
+        bool remove(Key const& key)
         {
             bucket_iterator const found_entry = find_entry(key);
             if(found_entry != m_data.end())
             {
                 m_data.erase(found_entry);
                 --m_size;
+                return true;
             }
+
+            return false;
         }
 
         std::size_t add_or_update(Key const& key, Value const& value)
@@ -125,10 +194,24 @@ private:
         std::vector<bucket_type> m_buckets;
     
     private:
-        std::vector<std::mutex> m_locks;
+        std::vector<Mutex> m_locks;
+#ifdef OMEGA_LOCK_STATS
+        std::shared_ptr<std::vector<stripe_counters>> m_lock_counters;
+        // Counters of the tables this one replaced, kept so the summed counters never go back
+        std::vector<std::shared_ptr<std::vector<stripe_counters> const>> m_retired_lock_counters;
+#endif
+        // Set when a stripe changes, cleared when a checkpoint copies it. Guarded by the stripe mutex
+        std::vector<std::uint8_t> m_dirty;
         std::size_t m_budget;
         Hash hasher;
 
+        void mark_dirty(Key const& key)
+        {
+            auto& dirty = m_dirty[get_mutex_index(key)];
+            if (!dirty)
+                dirty = 1;
+        }
+
         std::size_t get_mutex_index(Key const& key) const
         {
             return get_bucket_index(key) / m_budget;
@@ -150,15 +233,50 @@ private:
         }
 
     public:
+#ifdef OMEGA_LOCK_STATS
+        using mutex_guard = counted_lock_guard<Mutex>;
+#else
+        using mutex_guard = std::lock_guard<Mutex>;
+#endif
+
+        // Reports the stripe to the Tracer once it is locked and again right before m_guard unlocks it
+        class stripe_guard
+        {
+            mutex_guard m_guard;
+            std::size_t m_stripe;
+
+        public:
+            template<typename... Args>
+            explicit stripe_guard(std::size_t stripe, Args&... args)
+                : m_guard{args...}
+                , m_stripe{stripe}
+            {
+                Tracer::lock_acquired(m_stripe);
+            }
+
+            stripe_guard(stripe_guard const& other)=delete;
+            stripe_guard& operator=(stripe_guard const& other)=delete;
+
+            ~stripe_guard()
+            {
+                Tracer::lock_released(m_stripe);
+            }
+        };
+
         struct table_size
         {
             std::size_t buckets_size;
             std::size_t current_bucket_size;
+            bool inserted;
         };
 
         table_type(std::size_t concurrency, std::size_t buckets_count)
             : m_buckets{buckets_count}
             , m_locks{concurrency}
+#ifdef OMEGA_LOCK_STATS
+            , m_lock_counters{std::make_shared<std::vector<stripe_counters>>(concurrency)}
+#endif
+            , m_dirty(concurrency, 1)
             , m_budget{std::size_t(std::ceil(float(buckets_count) / concurrency))}
         {}
 
@@ -167,25 +285,157 @@ private:
             return get_bucket(key).get_value(key);
         }
 
-        void remove(Key const& key)
+        bool remove(Key const& key)
         {
+            mark_dirty(key);
             return get_bucket(key).remove(key);
         }
 
         table_size add_or_update(Key const& key, Value const& value)
         {
-            return table_size{m_buckets.size(), get_bucket(key).add_or_update(key, value)};
+            mark_dirty(key);
+            bucket_type& bucket = get_bucket(key);
+            std::size_t const previous_size = bucket.get_data().size();
+            std::size_t const size = bucket.add_or_update(key, value);
+            return table_size{m_buckets.size(), size, size != previous_size};
+        }
+
+        // Returns whether the stripe changed since the last call, the stripe mutex must be held
+        bool take_dirty(std::size_t stripe)
+        {
+            bool const dirty = m_dirty[stripe] != 0;
+            m_dirty[stripe] = 0;
+            return dirty;
+        }
+
+        // Clears every flag and returns the stripes which were dirty, all stripe mutexes must be held
+        std::vector<std::size_t> take_all_dirty()
+        {
+            std::vector<std::size_t> stripes;
+            for (std::size_t stripe = 0; stripe < m_dirty.size(); ++stripe)
+            {
+                if (m_dirty[stripe])
+                    stripes.push_back(stripe);
+                m_dirty[stripe] = 0;
+            }
+            return stripes;
+        }
+
+        // The stripe mutex must be held
+        void mark_stripe_dirty(std::size_t stripe)
+        {
+            m_dirty[stripe] = 1;
+        }
+
+        std::size_t get_stripe_index(Key const& key) const
+        {
+            return get_mutex_index(key);
+        }
+
+        stripe_guard lock(Key const& key)
+        {
+            return lock_stripe(get_mutex_index(key));
         }
 
-        std::lock_guard<std::mutex> lock(Key const& key)
+        multiple_lock<Mutex> lock_all()
         {
-            auto bucket_index = get_mutex_index(key);
-            return std::lock_guard<std::mutex> {m_locks[bucket_index]};
+            return multiple_lock<Mutex>{m_locks};
         }
 
-        multiple_lock lock_all()
+        stripe_guard lock_stripe(std::size_t stripe)
         {
-            return multiple_lock{m_locks};
+#ifdef OMEGA_LOCK_STATS
+            return stripe_guard{stripe, m_locks[stripe], (*m_lock_counters)[stripe]};
+#else
+            return stripe_guard{stripe, m_locks[stripe]};
+#endif
+        }
+
+        // chain_lengths[n] grows by the number of buckets of the stripe holding n entries, the stripe mutex must be held
+        void count_chain_lengths(std::size_t stripe, std::vector<std::size_t>& chain_lengths) const
+        {
+            std::size_t const first = std::min(stripe * m_budget, m_buckets.size());
+            std::size_t const last = std::min(first + m_budget, m_buckets.size());
+            for (std::size_t i = first; i < last; ++i)
+            {
+                std::size_t const length = m_buckets[i].get_data().size();
+                if (length >= chain_lengths.size())
+                    chain_lengths.resize(length + 1);
+                ++chain_lengths[length];
+            }
+        }
+
+        lock_stats get_lock_stats() const
+        {
+            lock_stats stats;
+#ifdef OMEGA_LOCK_STATS
+            stats.stripes.reserve(m_lock_counters->size());
+            for (auto const& counters : *m_lock_counters)
+            {
+                stats.stripes.push_back(counters.load());
+            }
+            for (auto const& retired : m_retired_lock_counters)
+            {
+                for (auto const& counters : *retired)
+                {
+                    stats.retired.add(counters.load());
+                }
+            }
+#endif
+            return stats;
+        }
+
+        // Carries the lock counters of the table this one replaces, called before publishing it
+        void retire_lock_stats([[maybe_unused]] table_type const& previous)
+        {
+#ifdef OMEGA_LOCK_STATS
+            m_retired_lock_counters = previous.m_retired_lock_counters;
+            m_retired_lock_counters.push_back(previous.m_lock_counters);
+#endif
+        }
+
+        template<typename Func>
+        void for_each_in_stripe(std::size_t stripe, Func func) const
+        {
+            std::size_t const first = std::min(stripe * m_budget, m_buckets.size());
+            std::size_t const last = std::min(first + m_budget, m_buckets.size());
+            for (std::size_t i = first; i < last; ++i)
+            {
+                for (const auto& val : m_buckets[i].get_data())
+                {
+                    func(val.first, val.second);
+                }
+            }
+        }
+
+        template<typename Func>
+        void update_in_stripe(std::size_t stripe, Func& func, bool track_dirty)
+        {
+            std::size_t const first = std::min(stripe * m_budget, m_buckets.size());
+            std::size_t const last = std::min(first + m_budget, m_buckets.size());
+            for (std::size_t i = first; i < last; ++i)
+            {
+                for (auto& val : m_buckets[i].get_data())
+                {
+                    func(val.first, val.second);
+                }
+            }
+            if (track_dirty)
+                m_dirty[stripe] = 1;
+        }
+
+        template<typename Func>
+        bool visit(Key const& key, Func& func, bool track_dirty)
+        {
+            bucket_type& bucket = get_bucket(key);
+            auto const found_entry = bucket.find_entry(key);
+            if (found_entry == bucket.get_data().end())
+                return false;
+
+            if (track_dirty)
+                mark_dirty(key);
+            func(found_entry->second);
+            return true;
         }
 
         std::size_t get_buckets_size() const
@@ -197,6 +447,11 @@ private:
         {
             return m_locks.size();
         }
+
+        std::size_t get_budget() const
+        {
+            return m_budget;
+        }
     };
 
     void resize(std::size_t new_size)
@@ -204,35 +459,274 @@ private:
         for(;;)
         {
             auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            auto const start = resize_counters::clock_type::now();
             auto const lock = table->lock_all();
+            auto const locked = resize_counters::clock_type::now();
             auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
             if (table != after_lock_table)
+            {
+                Tracer::table_replaced();
                 continue;
+            }
 
+            Tracer::resize_started(table->get_buckets_size());
             std::size_t new_concurrency = m_grow_mutexes_on_resize ?
                 std::min(2 * table->get_locks_size(), MAX_LOCK_NUMBER) :
                 table->get_locks_size();
             std::size_t new_capacity = 2 * table->get_buckets_size() + 1;
             auto new_table = std::make_shared<table_type>(new_concurrency, new_capacity);
 
+            std::size_t moved = 0;
             for (int i = 0; i < table->get_buckets_size(); ++i)
             {
                 for(const auto& val : table->m_buckets[i].get_data())
                 {
                     new_table->add_or_update(val.first, val.second);
+                    ++moved;
                 }
             }
+            new_table->retire_lock_stats(*table);
+            auto const rehashed = resize_counters::clock_type::now();
 
             std::atomic_store_explicit(&m_table, new_table, std::memory_order_release);
             std::atomic_flag_clear_explicit(&m_resize_in_process, std::memory_order_relaxed); 
+            m_resize_counters.record(start, locked, rehashed, resize_counters::clock_type::now(), moved);
+            Tracer::resize_finished(new_capacity, moved);
             break;
         }
     }
 
+    // Visits stripes [first, last) one at a time, returns false if a resize replaced the table meanwhile.
+    // on_stripe runs under the stripe mutex, after_stripe runs once it is released
+    template<typename LockedFunc, typename StripeFunc>
+    bool visit_stripes(std::shared_ptr<table_type> const& table, std::size_t first, std::size_t last,
+                       LockedFunc on_stripe, StripeFunc after_stripe) const
+    {
+        for (std::size_t stripe = first; stripe < last; ++stripe)
+        {
+            {
+                auto const lock = table->lock_stripe(stripe);
+                auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+                if (table != after_lock_table)
+                {
+                    Tracer::table_replaced();
+                    return false;
+                }
+
+                on_stripe(stripe);
+            }
+
+            after_stripe(stripe);
+        }
+
+        return true;
+    }
+
+    template<typename Func>
+    bool visit_entry(Key const& key, Func& func, bool track_dirty)
+    {
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            auto const lock = table->lock(key);
+            auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (table == after_lock_table)
+                return table->visit(key, func, track_dirty);
+            Tracer::table_replaced();
+        }
+    }
+
+    template<typename Func>
+    void update_each(Func& func, bool track_dirty)
+    {
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (visit_stripes(table, 0, table->get_locks_size(),
+                    [&table, &func, track_dirty](std::size_t stripe) { table->update_in_stripe(stripe, func, track_dirty); },
+                    [](std::size_t) {}))
+                break;
+        }
+    }
+
+    // Marks stripes dirty again after a checkpoint which took their flags failed. A table replaced by a
+    // resize meanwhile starts with every stripe dirty, so nothing is left to restore then
+    void restore_dirty(std::shared_ptr<table_type> const& table, std::vector<std::size_t> const& stripes) const
+    {
+        for (std::size_t stripe : stripes)
+        {
+            if (!table)
+                return;
+            auto const lock = table->lock_stripe(stripe);
+            if (table != std::atomic_load_explicit(&m_table, std::memory_order_acquire))
+                return;
+            table->mark_stripe_dirty(stripe);
+        }
+    }
+
+    // Snapshot chunks are contiguous stripe ranges, a few per thread to balance uneven stripes
+    static std::size_t get_chunk_count(table_type const& table, snapshot_options const& options)
+    {
+        return std::max<std::size_t>(std::min(table.get_locks_size(), 4 * options.threads), 1);
+    }
+
+    static std::pair<std::size_t, std::size_t> get_chunk_stripes(table_type const& table, std::size_t chunk, std::size_t chunk_count)
+    {
+        std::size_t const locks = table.get_locks_size();
+        return {chunk * locks / chunk_count, (chunk + 1) * locks / chunk_count};
+    }
+
+    static auto make_entry_serializer(std::vector<char>& buffer, std::uint64_t& count)
+    {
+        return [&buffer, &count](Key const& key, Value const& value)
+        {
+            snapshot_serializer<Key>::write(buffer, key);
+            snapshot_serializer<Value>::write(buffer, value);
+            ++count;
+        };
+    }
+
+    snapshot_info write_snapshot(std::string const& path, snapshot_options const& options, std::uint64_t log_lsn) const
+    {
+        snapshot_file file{path, O_WRONLY | O_CREAT | O_TRUNC | (options.direct_io ? O_DIRECT : 0)};
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            std::size_t const chunk_count = get_chunk_count(*table, options);
+            snapshot_info info{};
+            std::mutex taken_mutex;
+            std::vector<std::size_t> taken;
+            bool complete = false;
+            try
+            {
+                complete = write_chunked_snapshot(file, chunk_count, options, log_lsn,
+                    [this, &table, chunk_count, &taken_mutex, &taken](std::size_t chunk, std::vector<char>& buffer, std::uint64_t& count)
+                    {
+                        auto const stripes = get_chunk_stripes(*table, chunk, chunk_count);
+                        return visit_stripes(table, stripes.first, stripes.second,
+                            [&table, &buffer, &count, &taken_mutex, &taken](std::size_t stripe)
+                            {
+                                if (table->take_dirty(stripe))
+                                {
+                                    std::lock_guard<std::mutex> const lock{taken_mutex};
+                                    taken.push_back(stripe);
+                                }
+                                table->for_each_in_stripe(stripe, make_entry_serializer(buffer, count));
+                            },
+                            [](std::size_t) {});
+                    },
+                    info);
+            }
+            catch (...)
+            {
+                // The stripes were not checkpointed, the next delta has to write them
+                restore_dirty(table, taken);
+                throw;
+            }
+            if (complete)
+                return info;
+        }
+    }
+
+    static void write_frozen_snapshot(table_type const& table, std::string const& path, std::uint64_t log_lsn)
+    {
+        snapshot_file file{path, O_WRONLY | O_CREAT | O_TRUNC};
+        snapshot_options options;
+        options.threads = 1;
+        std::size_t const chunk_count = get_chunk_count(table, options);
+        snapshot_info info{};
+        write_chunked_snapshot(file, chunk_count, options, log_lsn,
+            [&table, chunk_count](std::size_t chunk, std::vector<char>& buffer, std::uint64_t& count)
+            {
+                auto const stripes = get_chunk_stripes(table, chunk, chunk_count);
+                for (std::size_t stripe = stripes.first; stripe < stripes.second; ++stripe)
+                {
+                    table.for_each_in_stripe(stripe, make_entry_serializer(buffer, count));
+                }
+                return true;
+            },
+            info);
+    }
+
+    // Version 1 and 2 snapshots are a single stream of entries, parsed sequentially
+    void load_stream_snapshot(std::string const& path, snapshot_header const& header, std::size_t threads)
+    {
+        constexpr std::size_t batch_size = 4096;
+        mapped_file file{path};
+        batch_queue<std::pair<Key, Value>> queue{2 * std::max<std::size_t>(threads, 1)};
+        std::vector<std::thread> workers;
+        for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+        {
+            workers.emplace_back([this, &queue]()
+            {
+                std::vector<std::pair<Key, Value>> batch;
+                while (queue.pop(batch))
+                {
+                    for (const auto& val : batch)
+                    {
+                        add_or_update(val.first, val.second);
+                    }
+                }
+            });
+        }
+
+        char const* cursor = file.data() + snapshot_header_size(header);
+        char const* const end = file.data() + file.size();
+        bool truncated = false;
+        std::vector<std::pair<Key, Value>> batch;
+        for (std::uint64_t i = 0; i < header.entry_count; ++i)
+        {
+            std::pair<Key, Value> entry;
+            if (!snapshot_serializer<Key>::read(cursor, end, entry.first) ||
+                !snapshot_serializer<Value>::read(cursor, end, entry.second))
+            {
+                truncated = true;
+                break;
+            }
+
+            batch.push_back(std::move(entry));
+            if (batch.size() == batch_size)
+            {
+                queue.push(std::move(batch));
+                batch.clear();
+            }
+        }
+
+        if (!batch.empty())
+            queue.push(std::move(batch));
+
+        queue.close();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        if (truncated)
+            throw std::runtime_error("snapshot is truncated");
+    }
+
 public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using hasher = Hash;
+
     std::shared_ptr<table_type> m_table;
     bool m_grow_mutexes_on_resize;
     std::atomic_flag m_resize_in_process = false;
+    std::shared_ptr<mutation_sink<Key, Value>> m_log;
+    std::unique_ptr<hot_key_tracker<Key, Hash>> m_hot_keys;
+    std::unique_ptr<operation_counters> m_operations;
+    std::shared_ptr<trace_recorder<Key, Value, Hash>> m_trace;
+    resize_counters m_resize_counters;
+
+    struct pending_fork
+    {
+        std::weak_ptr<table_type> table;
+        // Stripes whose dirty flags the fork took
+        std::vector<std::size_t> stripes;
+    };
+    mutable std::mutex m_forks_mutex;
+    mutable std::map<pid_t, pending_fork> m_forks;
     constexpr static std::size_t MAX_LOCK_NUMBER = 1024;
     concurrent_lookup_table(std::size_t concurrency, std::size_t capacity, bool grow_concurrency_on_resize = true)
         : m_table{std::make_shared<table_type>(concurrency, std::max(capacity, concurrency))}
@@ -243,20 +737,418 @@ public:
     concurrent_lookup_table(concurrent_lookup_table const& other)=delete;
     concurrent_lookup_table& operator=(concurrent_lookup_table const& other)=delete;
 
+    // Every following mutation is appended to the log while its stripe is locked.
+    // Must be called before the table is shared between threads
+    void attach_log(std::shared_ptr<mutation_sink<Key, Value>> log)
+    {
+        m_log = std::move(log);
+    }
+
+    // Samples keys passed to get_value and add_or_update to find the most accessed ones.
+    // Must be called before the table is shared between threads
+    void track_hot_keys(hot_key_options options = {})
+    {
+        m_hot_keys = std::make_unique<hot_key_tracker<Key, Hash>>(options);
+    }
+
+    // Up to k most accessed keys with estimated access counts, empty unless track_hot_keys was called
+    std::vector<hot_key<Key>> hot_keys(std::size_t k) const
+    {
+        return m_hot_keys ? m_hot_keys->top(k) : std::vector<hot_key<Key>>{};
+    }
+
+    // Every following get_value, add_or_update and remove is recorded into the trace before it runs.
+    // Must be called before the table is shared between threads
+    void attach_trace(std::shared_ptr<trace_recorder<Key, Value, Hash>> trace)
+    {
+        m_trace = std::move(trace);
+    }
+
+    // Counts operations and inserted/removed entries in per-thread counters for metrics().
+    // Must be called before the table is shared between threads
+    void enable_metrics()
+    {
+        m_operations = std::make_unique<operation_counters>();
+    }
+
+    // Operation counts, entries, table shape, resize and lock counters, read without taking any stripe mutex
+    table_metrics metrics() const
+    {
+        table_metrics result;
+        if (m_operations)
+            m_operations->load(result);
+
+        auto const table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+        result.buckets = table->get_buckets_size();
+        result.locks = table->get_locks_size();
+        result.contention = table->get_lock_stats().cumulative();
+
+        table_telemetry resizes;
+        m_resize_counters.load(resizes);
+        result.resizes = resizes.resizes;
+        result.resize_entries_moved = resizes.entries_moved;
+        result.resize_total = resizes.total;
+        return result;
+    }
+
+    std::uint64_t recover_from_log(std::string const& path, std::uint64_t from_lsn = 0)
+    {
+        return replay_mutation_log<Key, Value>(path, *this, from_lsn);
+    }
+
+    void reserve(std::size_t count)
+    {
+        std::size_t const new_capacity = reserve_capacity(count, MaxLoadFactor);
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (table->get_buckets_size() >= new_capacity)
+                break;
+
+            auto const start = resize_counters::clock_type::now();
+            auto const lock = table->lock_all();
+            auto const locked = resize_counters::clock_type::now();
+            auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (table != after_lock_table)
+            {
+                Tracer::table_replaced();
+                continue;
+            }
+
+            Tracer::resize_started(table->get_buckets_size());
+            std::size_t growth = new_capacity / table->get_buckets_size() + 1;
+            std::size_t new_concurrency = m_grow_mutexes_on_resize ?
+                std::min(growth * table->get_locks_size(), MAX_LOCK_NUMBER) :
+                table->get_locks_size();
+            auto new_table = std::make_shared<table_type>(new_concurrency, new_capacity);
+
+            std::size_t moved = 0;
+            for (std::size_t i = 0; i < table->get_buckets_size(); ++i)
+            {
+                for(const auto& val : table->m_buckets[i].get_data())
+                {
+                    new_table->add_or_update(val.first, val.second);
+                    ++moved;
+                }
+            }
+            new_table->retire_lock_stats(*table);
+            auto const rehashed = resize_counters::clock_type::now();
+
+            std::atomic_store_explicit(&m_table, new_table, std::memory_order_release);
+            m_resize_counters.record(start, locked, rehashed, resize_counters::clock_type::now(), moved);
+            Tracer::resize_finished(new_capacity, moved);
+            break;
+        }
+    }
+
+    // Fuzzy checkpoint: stripes are copied one at a time while the table keeps serving.
+    // Together with log records from the returned log_lsn on it restores a consistent state.
+    // Chunks of stripes are serialized, checksummed and written by options.threads threads
+    snapshot_info save_snapshot(std::string const& path, snapshot_options options = {}) const
+    {
+        return write_snapshot(path, options, m_log ? m_log->next_lsn() : 0);
+    }
+
+    // Writes only the stripes changed since the previous checkpoint(full or delta), the table keeps serving
+    snapshot_info save_delta_snapshot(std::string const& path) const
+    {
+        snapshot_file file{path, O_WRONLY | O_CREAT | O_TRUNC};
+        std::uint64_t const log_lsn = m_log ? m_log->next_lsn() : 0;
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            snapshot_info info{0, log_lsn};
+            std::uint64_t offset = sizeof(delta_header);
+            std::uint64_t stripe_count = 0;
+            std::uint64_t count = 0;
+            std::vector<char> buffer;
+            std::vector<std::size_t> taken;
+            bool dirty = false;
+            try
+            {
+                bool const complete = visit_stripes(table, 0, table->get_locks_size(),
+                    [&table, &dirty, &buffer, &count, &taken](std::size_t stripe)
+                    {
+                        dirty = table->take_dirty(stripe);
+                        if (dirty)
+                        {
+                            taken.push_back(stripe);
+                            table->for_each_in_stripe(stripe, make_entry_serializer(buffer, count));
+                        }
+                    },
+                    [&](std::size_t stripe)
+                    {
+                        if (!dirty)
+                            return;
+
+                        delta_stripe const record{stripe, count, buffer.size(), crc32c(buffer.data(), buffer.size()), 0};
+                        file.write_at(&record, sizeof(record), offset);
+                        file.write_at(buffer.data(), buffer.size(), offset + sizeof(record));
+                        offset += sizeof(record) + buffer.size();
+                        info.entry_count += count;
+                        ++stripe_count;
+                        count = 0;
+                        buffer.clear();
+                    });
+                if (!complete)
+                    continue;
+
+                delta_header header{};
+                std::memcpy(header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC));
+                header.version = DELTA_VERSION;
+                header.log_lsn = log_lsn;
+                header.buckets_count = table->get_buckets_size();
+                header.budget = table->get_budget();
+                header.stripe_count = stripe_count;
+                file.write_at(&header, sizeof(header), 0);
+                file.truncate(offset);
+                file.sync();
+                return info;
+            }
+            catch (...)
+            {
+                restore_dirty(table, taken);
+                throw;
+            }
+        }
+    }
+
+    // Replaces every stripe recorded in the delta. Meant for recovery, concurrent writers may interleave
+    snapshot_info apply_delta_snapshot(std::string const& path)
+    {
+        mapped_file file{path};
+        delta_header const header = read_delta_header(file);
+        char const* cursor = file.data() + sizeof(header);
+        char const* const end = file.data() + file.size();
+        std::unordered_set<std::uint64_t> stripes;
+        std::vector<std::pair<Key, Value>> entries;
+        for (std::uint64_t i = 0; i < header.stripe_count; ++i)
+        {
+            delta_stripe record{};
+            if (!snapshot_serializer<delta_stripe>::read(cursor, end, record) ||
+                std::uint64_t(end - cursor) < record.size)
+                throw std::runtime_error("delta snapshot is truncated");
+            if (crc32c(cursor, record.size) != record.crc)
+                throw std::runtime_error("delta snapshot stripe " + std::to_string(record.stripe) + " is corrupted");
+
+            char const* const stripe_end = cursor + record.size;
+            for (std::uint64_t j = 0; j < record.entry_count; ++j)
+            {
+                std::pair<Key, Value> entry;
+                if (!snapshot_serializer<Key>::read(cursor, stripe_end, entry.first) ||
+                    !snapshot_serializer<Value>::read(cursor, stripe_end, entry.second))
+                    throw std::runtime_error("delta snapshot stripe is malformed");
+                entries.push_back(std::move(entry));
+            }
+            cursor = stripe_end;
+            stripes.insert(record.stripe);
+        }
+
+        Hash hasher;
+        std::vector<Key> removed;
+        for(;;)
+        {
+            removed.clear();
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (visit_stripes(table, 0, table->get_locks_size(),
+                    [&](std::size_t stripe)
+                    {
+                        table->for_each_in_stripe(stripe, [&](Key const& key, Value const&)
+                        {
+                            if (stripes.count(hasher(key) % header.buckets_count / header.budget))
+                                removed.push_back(key);
+                        });
+                    },
+                    [](std::size_t) {}))
+                break;
+        }
+
+        for (const auto& key : removed)
+        {
+            remove(key);
+        }
+
+        for (const auto& val : entries)
+        {
+            add_or_update(val.first, val.second);
+        }
+
+        return snapshot_info{entries.size(), header.log_lsn};
+    }
+
+    // Merges a chain of delta snapshots into their full base snapshot and writes the result to out_path
+    static snapshot_info compact_snapshots(std::string const& base_path, std::vector<std::string> const& delta_paths,
+                                           std::string const& out_path, snapshot_options options = {})
+    {
+        concurrent_lookup_table table{std::min(options.threads * 16, MAX_LOCK_NUMBER), 1024};
+        snapshot_info info = table.load_snapshot(base_path, options);
+        for (const auto& delta_path : delta_paths)
+        {
+            info = table.apply_delta_snapshot(delta_path);
+        }
+
+        return table.write_snapshot(out_path, options, info.log_lsn);
+    }
+
+    // Quiesces writers with lock_all() only for the duration of fork(). The child writes the
+    // frozen copy-on-write image on its only thread without locks and exits, wait_for_snapshot(pid)
+    // reports the result. Dirty flags restart at the fork and come back if the child fails
+    pid_t snapshot_via_fork(std::string const& path) const
+    {
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            auto const lock = table->lock_all();
+            auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (table != after_lock_table)
+            {
+                Tracer::table_replaced();
+                continue;
+            }
+
+            std::uint64_t const log_lsn = m_log ? m_log->next_lsn() : 0;
+            pid_t const pid = ::fork();
+            if (pid < 0)
+                throw std::system_error(errno, std::generic_category(), "fork failed");
+
+            if (pid == 0)
+            {
+                int status = 0;
+                try
+                {
+                    write_frozen_snapshot(*table, path, log_lsn);
+                }
+                catch (...)
+                {
+                    status = 1;
+                }
+                ::_exit(status);
+            }
+
+            std::lock_guard<std::mutex> const forks_lock{m_forks_mutex};
+            m_forks[pid] = pending_fork{table, table->take_all_dirty()};
+            return pid;
+        }
+    }
+
+    // Waits for a snapshot_via_fork child. When it failed, the stripes which were dirty at the fork are
+    // marked dirty again, so the next delta snapshot still covers them
+    bool wait_for_snapshot(pid_t pid) const
+    {
+        bool const written = omega::wait_for_snapshot(pid);
+        pending_fork fork;
+        {
+            std::lock_guard<std::mutex> const forks_lock{m_forks_mutex};
+            auto const found = m_forks.find(pid);
+            if (found == m_forks.end())
+                return written;
+            fork = std::move(found->second);
+            m_forks.erase(found);
+        }
+
+        if (!written)
+            restore_dirty(fork.table.lock(), fork.stripes);
+        return written;
+    }
+
+    std::future<snapshot_info> start_checkpoint(std::string const& path) const
+    {
+        return std::async(std::launch::async, [this, path]() { return save_snapshot(path); });
+    }
+
+    void save_mapped_snapshot(std::string const& path) const
+    {
+        std::vector<std::pair<Key, Value>> entries;
+        for(;;)
+        {
+            entries.clear();
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            if (visit_stripes(table, 0, table->get_locks_size(),
+                    [&table, &entries](std::size_t stripe)
+                    {
+                        table->for_each_in_stripe(stripe, [&entries](Key const& key, Value const& value)
+                        {
+                            entries.emplace_back(key, value);
+                        });
+                    },
+                    [](std::size_t) {}))
+                break;
+        }
+
+        write_mapped_table<Key, Value, Hash>(path, entries);
+    }
+
+    snapshot_info load_snapshot(std::string const& path, snapshot_options options = {})
+    {
+        snapshot_file file{path, O_RDONLY | (options.direct_io ? O_DIRECT : 0)};
+        snapshot_header const header = read_snapshot_header(file);
+        reserve(header.entry_count);
+        if (header.version < 3)
+        {
+            load_stream_snapshot(path, header, options.threads);
+            return snapshot_info{header.entry_count, header.log_lsn};
+        }
+
+        read_chunked_snapshot(file, header, options, [this](char const* data, std::size_t size, std::uint64_t count)
+        {
+            char const* cursor = data;
+            char const* const end = data + size;
+            for (std::uint64_t i = 0; i < count; ++i)
+            {
+                std::pair<Key, Value> entry;
+                if (!snapshot_serializer<Key>::read(cursor, end, entry.first) ||
+                    !snapshot_serializer<Value>::read(cursor, end, entry.second))
+                    throw std::runtime_error("snapshot chunk is malformed");
+
+                add_or_update(entry.first, entry.second);
+            }
+        });
+
+        return snapshot_info{header.entry_count, header.log_lsn};
+    }
+
+    snapshot_info load_snapshot(std::string const& path, std::size_t threads)
+    {
+        snapshot_options options;
+        options.threads = std::max<std::size_t>(threads, 1);
+        return load_snapshot(path, options);
+    }
+
+    // Loads the latest checkpoint and replays the log from the position it recorded
+    std::uint64_t recover(std::string const& snapshot_path, std::string const& log_path)
+    {
+        snapshot_info const info = load_snapshot(snapshot_path);
+        return recover_from_log(log_path, info.log_lsn);
+    }
+
     std::optional<Value> get_value(Key const& key) const
     {
+        if (m_hot_keys)
+            m_hot_keys->record(key);
+        if (m_trace)
+            m_trace->record(trace_operation::get_value, key, 0);
         for(;;)
         {
             auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
             auto const lock = table->lock(key);
             auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
             if (table == after_lock_table)
-                return table->get_value (key);
+            {
+                std::optional<Value> value = table->get_value(key);
+                if (m_operations)
+                    m_operations->record_get_value(value.has_value());
+                return value;
+            }
+            Tracer::table_replaced();
         }
     }
 
     void add_or_update(Key const& key, Value const& value)
     {
+        if (m_hot_keys)
+            m_hot_keys->record(key);
+        if (m_trace)
+            m_trace->record_update(key, value);
         typename table_type::table_size size;
         bool should_resize = false;
         for(;;)
@@ -265,9 +1157,16 @@ public:
             auto const lock = table->lock(key);
             auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
             if (table != after_lock_table)
+            {
+                Tracer::table_replaced();
                 continue;
+            }
             
             size = table->add_or_update(key, value);
+            if (m_log)
+                m_log->append_update(key, value);
+            if (m_operations)
+                m_operations->record_add_or_update(1, size.inserted);
             if (size.current_bucket_size > MaxLoadFactor &&
                 std::atomic_flag_test_and_set_explicit(&m_resize_in_process, std::memory_order_relaxed))
             {
@@ -282,17 +1181,174 @@ public:
         }
     }
 
+    // Groups entries by stripe and takes every stripe mutex once per batch instead of once per entry
+    void add_or_update_batch(std::vector<std::pair<Key, Value>> const& entries)
+    {
+        if (m_hot_keys)
+        {
+            for (auto const& entry : entries)
+            {
+                m_hot_keys->record(entry.first);
+            }
+        }
+        if (m_trace)
+        {
+            for (auto const& entry : entries)
+            {
+                m_trace->record_update(entry.first, entry.second);
+            }
+        }
+
+        std::vector<std::pair<std::size_t, std::size_t>> pending;
+        std::vector<std::size_t> remaining(entries.size());
+        for (std::size_t i = 0; i < remaining.size(); ++i)
+        {
+            remaining[i] = i;
+        }
+
+        std::size_t buckets_size = 0;
+        bool should_resize = false;
+        while (!remaining.empty())
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            pending.clear();
+            for (std::size_t index : remaining)
+            {
+                pending.emplace_back(table->get_stripe_index(entries[index].first), index);
+            }
+            std::sort(pending.begin(), pending.end());
+            remaining.clear();
+
+            for (auto group = pending.begin(); group != pending.end();)
+            {
+                auto const group_end = std::find_if(group, pending.end(),
+                    [stripe = group->first](std::pair<std::size_t, std::size_t> const& item) { return item.first != stripe; });
+                auto const lock = table->lock_stripe(group->first);
+                auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+                if (table != after_lock_table)
+                {
+                    Tracer::table_replaced();
+                    for (; group != pending.end(); ++group)
+                    {
+                        remaining.push_back(group->second);
+                    }
+                    break;
+                }
+
+                std::size_t const group_size = std::size_t(group_end - group);
+                std::size_t inserted = 0;
+                for (; group != group_end; ++group)
+                {
+                    auto const& entry = entries[group->second];
+                    auto const size = table->add_or_update(entry.first, entry.second);
+                    inserted += size.inserted;
+                    if (m_log)
+                        m_log->append_update(entry.first, entry.second);
+                    if (size.current_bucket_size > MaxLoadFactor && !should_resize &&
+                        std::atomic_flag_test_and_set_explicit(&m_resize_in_process, std::memory_order_relaxed))
+                    {
+                        should_resize = true;
+                        buckets_size = size.buckets_size;
+                    }
+                }
+                if (m_operations)
+                    m_operations->record_add_or_update(group_size, inserted);
+            }
+        }
+
+        if (should_resize)
+        {
+            resize(2 * buckets_size + 1);
+        }
+    }
+
+    // Calls func(value) on the entry under its stripe mutex, returns false if the key is absent.
+    // Changes made through visit are not written to an attached mutation log
+    template<typename Func>
+    bool visit(Key const& key, Func func)
+    {
+        return visit_entry(key, func, true);
+    }
+
+    // Like visit, but leaves the stripe out of the next delta snapshot. For changes which checkpoints
+    // need not capture, such as cache bookkeeping kept next to the value
+    template<typename Func>
+    bool visit_untracked(Key const& key, Func func)
+    {
+        return visit_entry(key, func, false);
+    }
+
+    // Calls func(key, value) for every entry, holding only the mutex of the stripe being visited.
+    // A resize restarts the walk, so func may see an entry more than once
+    template<typename Func>
+    void for_each(Func func)
+    {
+        update_each(func, true);
+    }
+
+    // Like for_each, but leaves every stripe's dirty flag alone
+    template<typename Func>
+    void for_each_untracked(Func func)
+    {
+        update_each(func, false);
+    }
+
+    // Acquire counts, contended acquires, wait and hold time per stripe mutex of the current table.
+    // Stripes are empty unless compiled with OMEGA_LOCK_STATS, a resize starts them from zero and adds the
+    // replaced table's counters to retired
+    lock_stats stats() const
+    {
+        return std::atomic_load_explicit(&m_table, std::memory_order_acquire)->get_lock_stats();
+    }
+
+    // Resize counters and the shape of the current table. The chain length histogram is collected
+    // holding one stripe mutex at a time and restarts if a resize replaces the table meanwhile
+    table_telemetry telemetry() const
+    {
+        table_telemetry result;
+        for(;;)
+        {
+            auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
+            result.chain_lengths.assign(MaxLoadFactor + 2, 0);
+            if (visit_stripes(table, 0, table->get_locks_size(),
+                    [&table, &result](std::size_t stripe) { table->count_chain_lengths(stripe, result.chain_lengths); },
+                    [](std::size_t) {}))
+            {
+                result.buckets = table->get_buckets_size();
+                result.locks = table->get_locks_size();
+                break;
+            }
+        }
+
+        for (std::size_t length = 0; length < result.chain_lengths.size(); ++length)
+        {
+            result.entries += length * result.chain_lengths[length];
+        }
+        result.load_factor = result.buckets ? double(result.entries) / result.buckets : 0.0;
+        m_resize_counters.load(result);
+        return result;
+    }
+
     void remove(Key const& key)
     {
+        if (m_trace)
+            m_trace->record(trace_operation::remove, key, 0);
         for(;;)
         {
             auto table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
             auto const lock = table->lock(key);
             auto after_lock_table = std::atomic_load_explicit(&m_table, std::memory_order_acquire);
             if (table != after_lock_table)
+            {
+                Tracer::table_replaced();
                 continue;
+            }
             
-            table->remove(key);
+            bool const removed = table->remove(key);
+            if (m_log)
+                m_log->append_remove(key);
+            if (m_operations)
+                m_operations->record_remove(removed);
             break;
         }
     }
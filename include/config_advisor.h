@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "concurrent_lookup_table.h"
+#include "lock_stats.h"
+#include "table_metrics.h"
+#include "table_telemetry.h"
+
+namespace omega
+{
+struct table_config
+{
+    std::size_t concurrency = 0;
+    std::size_t capacity = 0;
+    bool grow_concurrency_on_resize = true;
+    std::size_t max_load_factor = 4;
+};
+
+// What was observed while the table ran with a given configuration
+struct table_observation
+{
+    table_config config;
+    table_telemetry telemetry;
+    table_metrics metrics;
+    // Empty unless compiled with OMEGA_LOCK_STATS
+    lock_stats locks;
+    // Largest number of entries seen during the run, the entries at the end are used if 0
+    std::size_t peak_entries = 0;
+};
+
+struct config_advice
+{
+    table_config config;
+    // Resizes and their total duration which the recommended capacity avoids
+    std::uint64_t resizes_avoided = 0;
+    std::uint64_t resize_ns_avoided = 0;
+    // Share of stripe acquires which had to wait, observed and expected with the recommended concurrency
+    double contention = 0.0;
+    double predicted_contention = 0.0;
+    // Busiest stripe acquires over the average, close to 1 for a well spread hash
+    double stripe_skew = 0.0;
+    // Entries compared by a successful lookup on average, observed and expected with the recommended
+    // capacity and load factor
+    double probe_length = 0.0;
+    double predicted_probe_length = 0.0;
+    std::vector<std::string> notes;
+};
+
+struct advisor_options
+{
+    // Contention share above which more stripes are recommended
+    double target_contention = 0.005;
+    // Share of get_value calls above which lookups dominate and read_probe_length applies
+    double read_heavy = 0.9;
+    // Longest predicted mean probe length accepted for read-heavy and other runs, among the
+    // acceptable MaxLoadFactor candidates the one needing the fewest buckets wins
+    double read_probe_length = 1.25;
+    double write_probe_length = 1.75;
+    std::vector<std::size_t> load_factors = {2, 4, 8};
+    std::size_t max_concurrency = 1024;
+};
+
+namespace advisor_detail
+{
+inline std::size_t round_up_to_power_of_two(std::size_t value)
+{
+    std::size_t result = 1;
+    while (result < value)
+    {
+        result *= 2;
+    }
+    return result;
+}
+
+// Average entries compared by a successful lookup when a chain of n entries holds each of them once
+inline double mean_probe_length(std::vector<std::size_t> const& chain_lengths)
+{
+    double compared = 0.0;
+    double entries = 0.0;
+    for (std::size_t length = 1; length < chain_lengths.size(); ++length)
+    {
+        compared += double(chain_lengths[length]) * double(length) * double(length + 1) / 2.0;
+        entries += double(chain_lengths[length]) * double(length);
+    }
+    return entries > 0.0 ? compared / entries : 0.0;
+}
+}
+
+// Heuristic recommendations, every field of the result documents its expected effect:
+// - capacity is what reserve() picks for the peak entries, so most observed resizes disappear
+// - MaxLoadFactor is the candidate needing the fewest buckets at that capacity while keeping lookups
+//   short, read-heavy runs accept shorter chains only
+// - concurrency grows in proportion to the observed contention, assuming acquires spread evenly
+//   over stripes; a skewed stripe is reported instead since more stripes do not split a hot key.
+//   Without lock statistics the configured concurrency is kept
+inline config_advice advise(table_observation const& observation, advisor_options const& options = {})
+{
+    using namespace advisor_detail;
+
+    table_config const& current = observation.config;
+    config_advice advice;
+    advice.config = current;
+    advice.probe_length = mean_probe_length(observation.telemetry.chain_lengths);
+
+    std::size_t const entries = std::max<std::size_t>(
+        observation.peak_entries ? observation.peak_entries : observation.telemetry.entries, 1);
+    std::uint64_t const operations = observation.metrics.get_values + observation.metrics.add_or_updates +
+                                     observation.metrics.removes;
+    double const read_share = operations ? double(observation.metrics.get_values) / double(operations) : 0.0;
+
+    if (operations == 0)
+        advice.notes.push_back("operation mix unknown, call enable_metrics() before the run to tune MaxLoadFactor");
+    double const probe_limit = read_share >= options.read_heavy ? options.read_probe_length : options.write_probe_length;
+    std::size_t best_capacity = 0;
+    for (std::size_t load_factor : options.load_factors)
+    {
+        std::size_t const capacity = reserve_capacity(entries, load_factor);
+        double const probe_length = 1.0 + double(entries) / double(capacity) / 2.0;
+        bool const acceptable = probe_length <= probe_limit;
+        bool const chosen_acceptable = advice.predicted_probe_length <= probe_limit;
+        // Prefer acceptable chains, then fewer buckets; with no acceptable candidate the shortest chains
+        if (best_capacity == 0 || (acceptable && (!chosen_acceptable || capacity < best_capacity)) ||
+            (!acceptable && !chosen_acceptable && probe_length < advice.predicted_probe_length))
+        {
+            best_capacity = capacity;
+            advice.config.max_load_factor = load_factor;
+            advice.config.capacity = capacity;
+            advice.predicted_probe_length = probe_length;
+        }
+    }
+    if (best_capacity == 0)
+    {
+        advice.config.capacity = reserve_capacity(entries, current.max_load_factor);
+        advice.predicted_probe_length = 1.0 + double(entries) / double(advice.config.capacity) / 2.0;
+    }
+    advice.resizes_avoided = observation.telemetry.resizes;
+    advice.resize_ns_avoided = observation.telemetry.total.lock_ns + observation.telemetry.total.rehash_ns +
+                               observation.telemetry.total.publish_ns;
+
+    stripe_stats const total = observation.locks.total();
+    std::size_t concurrency = current.concurrency;
+    if (observation.locks.stripes.empty() || total.acquires == 0)
+    {
+        advice.notes.push_back("no lock statistics, build with OMEGA_LOCK_STATS to tune concurrency");
+    }
+    else
+    {
+        advice.contention = double(total.contended_acquires) / double(total.acquires);
+        std::uint64_t busiest = 0;
+        for (auto const& stripe : observation.locks.stripes)
+        {
+            busiest = std::max(busiest, stripe.acquires);
+        }
+        advice.stripe_skew = double(busiest) * double(observation.locks.stripes.size()) / double(total.acquires);
+
+        std::size_t const stripes = observation.locks.stripes.size();
+        if (advice.stripe_skew > 4.0)
+        {
+            advice.notes.push_back("one stripe takes " + std::to_string(int(advice.stripe_skew)) +
+                                   "x the average acquires, check hot_keys() or the hash before adding stripes");
+        }
+        else if (advice.contention > options.target_contention)
+        {
+            concurrency = round_up_to_power_of_two(
+                std::size_t(double(stripes) * advice.contention / options.target_contention + 0.5));
+        }
+        concurrency = std::min({std::max(concurrency, current.concurrency), options.max_concurrency,
+                                std::max<std::size_t>(advice.config.capacity, 1)});
+        // The contention was observed with the stripes the table grew to, fewer would raise it
+        if (stripes > concurrency)
+        {
+            concurrency = std::min(stripes, options.max_concurrency);
+            advice.notes.push_back("concurrency kept at the " + std::to_string(stripes) + " stripes the table grew to");
+        }
+        advice.predicted_contention = advice.contention * double(stripes) / double(std::max<std::size_t>(concurrency, 1));
+    }
+    advice.config.concurrency = std::max<std::size_t>(concurrency, 1);
+
+    // With the recommended capacity the table only resizes past the observed peak, stripes should then
+    // keep up with it whenever the run was already contended
+    advice.config.grow_concurrency_on_resize =
+        current.grow_concurrency_on_resize || advice.contention > options.target_contention;
+
+    return advice;
+}
+
+// Collects what advise() needs from a table which had enable_metrics() called before the run
+template<typename Table>
+table_observation observe(Table const& table, table_config const& config, std::size_t peak_entries = 0)
+{
+    table_observation observation;
+    observation.config = config;
+    observation.telemetry = table.telemetry();
+    observation.metrics = table.metrics();
+    observation.locks = table.stats();
+    observation.peak_entries = peak_entries;
+    return observation;
+}
+
+inline std::string format_advice(config_advice const& advice, table_config const& current)
+{
+    char line[256];
+    std::string text;
+    std::snprintf(line, sizeof(line), "%-28s %12s %12s\n", "setting", "current", "recommended");
+    text += line;
+    std::snprintf(line, sizeof(line), "%-28s %12zu %12zu\n", "concurrency", current.concurrency, advice.config.concurrency);
+    text += line;
+    std::snprintf(line, sizeof(line), "%-28s %12zu %12zu\n", "capacity", current.capacity, advice.config.capacity);
+    text += line;
+    std::snprintf(line, sizeof(line), "%-28s %12d %12d\n", "grow_concurrency_on_resize",
+                  int(current.grow_concurrency_on_resize), int(advice.config.grow_concurrency_on_resize));
+    text += line;
+    std::snprintf(line, sizeof(line), "%-28s %12zu %12zu\n", "MaxLoadFactor", current.max_load_factor,
+                  advice.config.max_load_factor);
+    text += line;
+    std::snprintf(line, sizeof(line), "predicted: %llu resizes(%.3f ms) avoided, contention %.4f -> %.4f, "
+                  "probe length %.2f -> %.2f, stripe skew %.2f\n",
+                  static_cast<unsigned long long>(advice.resizes_avoided), double(advice.resize_ns_avoided) * 1e-6,
+                  advice.contention, advice.predicted_contention, advice.probe_length, advice.predicted_probe_length,
+                  advice.stripe_skew);
+    text += line;
+    for (auto const& note : advice.notes)
+    {
+        text += "note: " + note + "\n";
+    }
+    return text;
+}
+}
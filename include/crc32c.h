@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define OMEGA_CRC32C_SSE42 1
+#endif
+
+namespace omega
+{
+namespace detail
+{
+inline std::array<std::uint32_t, 256> const& crc32c_table()
+{
+    static std::array<std::uint32_t, 256> const table = []()
+    {
+        std::array<std::uint32_t, 256> result{};
+        for (std::uint32_t i = 0; i < 256; ++i)
+        {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+            }
+            result[i] = crc;
+        }
+        return result;
+    }();
+    return table;
+}
+
+inline std::uint32_t crc32c_software(std::uint32_t crc, unsigned char const* data, std::size_t size)
+{
+    auto const& table = crc32c_table();
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef OMEGA_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+inline std::uint32_t crc32c_sse42(std::uint32_t crc, unsigned char const* data, std::size_t size)
+{
+    std::uint64_t crc64 = crc;
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t), data += sizeof(std::uint64_t))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = std::uint32_t(crc64);
+    for (; size > 0; --size, ++data)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+
+    return crc;
+}
+#endif
+}
+
+// CRC32C(Castagnoli), uses the SSE4.2 crc32 instruction when the CPU has it
+inline std::uint32_t crc32c(void const* data, std::size_t size, std::uint32_t crc = 0)
+{
+    unsigned char const* bytes = static_cast<unsigned char const*>(data);
+#ifdef OMEGA_CRC32C_SSE42
+    static bool const hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~detail::crc32c_sse42(~crc, bytes, size);
+#endif
+    return ~detail::crc32c_software(~crc, bytes, size);
+}
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "per_thread.h"
+
+namespace omega
+{
+struct hot_key_options
+{
+    // One access in sample_rate is recorded
+    std::uint32_t sample_rate = 64;
+    // Keys tracked by the Space-Saving summary, keys hotter than 1/capacity of the samples are always among them
+    std::size_t capacity = 1024;
+    // Samples a thread collects before it merges them into the summary
+    std::size_t batch_size = 256;
+};
+
+template<typename Key>
+struct hot_key
+{
+    Key key;
+    // Estimated accesses, overestimated by at most error
+    std::uint64_t count;
+    std::uint64_t error;
+};
+
+// Space-Saving heavy hitters summary. Counters form a min-heap, so the least frequent key is
+// replaced in O(log capacity) when an untracked key arrives
+template<typename Key, typename Hash>
+class space_saving
+{
+    struct counter
+    {
+        Key key;
+        std::uint64_t count;
+        std::uint64_t error;
+    };
+
+    std::size_t m_capacity;
+    std::vector<counter> m_heap;
+    std::unordered_map<Key, std::size_t, Hash> m_positions;
+
+    void swap_counters(std::size_t first, std::size_t second)
+    {
+        std::swap(m_heap[first], m_heap[second]);
+        m_positions[m_heap[first].key] = first;
+        m_positions[m_heap[second].key] = second;
+    }
+
+    // Counts only grow, so a counter can only move towards the leaves
+    void sift_down(std::size_t position)
+    {
+        for (;;)
+        {
+            std::size_t smallest = position;
+            for (std::size_t child = 2 * position + 1; child <= 2 * position + 2 && child < m_heap.size(); ++child)
+            {
+                if (m_heap[child].count < m_heap[smallest].count)
+                    smallest = child;
+            }
+            if (smallest == position)
+                return;
+
+            swap_counters(position, smallest);
+            position = smallest;
+        }
+    }
+
+    void sift_up(std::size_t position)
+    {
+        while (position > 0 && m_heap[(position - 1) / 2].count > m_heap[position].count)
+        {
+            swap_counters(position, (position - 1) / 2);
+            position = (position - 1) / 2;
+        }
+    }
+
+public:
+    explicit space_saving(std::size_t capacity)
+        : m_capacity{std::max<std::size_t>(capacity, 1)}
+    {
+        m_heap.reserve(m_capacity);
+        m_positions.reserve(m_capacity);
+    }
+
+    void add(Key const& key)
+    {
+        auto const found = m_positions.find(key);
+        if (found != m_positions.end())
+        {
+            ++m_heap[found->second].count;
+            sift_down(found->second);
+        }
+        else if (m_heap.size() < m_capacity)
+        {
+            m_heap.push_back(counter{key, 1, 0});
+            m_positions.emplace(key, m_heap.size() - 1);
+            sift_up(m_heap.size() - 1);
+        }
+        else
+        {
+            counter& minimum = m_heap.front();
+            m_positions.erase(minimum.key);
+            minimum = counter{key, minimum.count + 1, minimum.count};
+            m_positions.emplace(key, 0);
+            sift_down(0);
+        }
+    }
+
+    // The k keys with the highest counts, most frequent first
+    std::vector<hot_key<Key>> top(std::size_t k) const
+    {
+        std::vector<hot_key<Key>> result;
+        result.reserve(m_heap.size());
+        for (auto const& counter : m_heap)
+        {
+            result.push_back(hot_key<Key>{counter.key, counter.count, counter.error});
+        }
+
+        auto const by_count = [](hot_key<Key> const& first, hot_key<Key> const& second) { return first.count > second.count; };
+        std::size_t const size = std::min(k, result.size());
+        std::partial_sort(result.begin(), result.begin() + size, result.end(), by_count);
+        result.erase(result.begin() + size, result.end());
+        return result;
+    }
+};
+
+// Samples accessed keys into per-thread buffers under an uncontended mutex and merges full buffers
+// into a shared Space-Saving summary, so the summary mutex is taken once per batch_size samples
+template<typename Key, typename Hash>
+class hot_key_tracker
+{
+    struct thread_samples
+    {
+        std::mutex mutex;
+        std::uint32_t countdown = 0;
+        // xorshift32 state, seeded from the slot address so that threads do not sample in lockstep
+        std::uint32_t random = std::uint32_t(reinterpret_cast<std::uintptr_t>(this) >> 4) | 1;
+        std::vector<Key> keys;
+
+        // Skips are uniform in [0, 2 * (sample_rate - 1)], a fixed stride would alias with periodic access patterns
+        std::uint32_t next_skip(std::uint32_t sample_rate)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            return random % (2 * sample_rate - 1);
+        }
+    };
+
+    hot_key_options m_options;
+    per_thread<thread_samples> m_samples;
+    std::mutex m_summary_mutex;
+    space_saving<Key, Hash> m_summary;
+
+    void merge(std::vector<Key>& keys)
+    {
+        std::lock_guard<std::mutex> lock{m_summary_mutex};
+        for (auto const& key : keys)
+        {
+            m_summary.add(key);
+        }
+        keys.clear();
+    }
+
+public:
+    explicit hot_key_tracker(hot_key_options options)
+        : m_options{options}
+        , m_summary{options.capacity}
+    {
+        m_options.sample_rate = std::max<std::uint32_t>(m_options.sample_rate, 1);
+    }
+
+    void record(Key const& key)
+    {
+        thread_samples& samples = m_samples.local();
+        if (samples.countdown > 0)
+        {
+            --samples.countdown;
+            return;
+        }
+
+        samples.countdown = samples.next_skip(m_options.sample_rate);
+        std::lock_guard<std::mutex> lock{samples.mutex};
+        samples.keys.push_back(key);
+        if (samples.keys.size() >= m_options.batch_size)
+            merge(samples.keys);
+    }
+
+    // Merges the samples buffered by every thread first. Counts are scaled back to accesses
+    std::vector<hot_key<Key>> top(std::size_t k)
+    {
+        m_samples.for_each([this](thread_samples& samples)
+        {
+            std::lock_guard<std::mutex> lock{samples.mutex};
+            merge(samples.keys);
+        });
+
+        std::vector<hot_key<Key>> result;
+        {
+            std::lock_guard<std::mutex> lock{m_summary_mutex};
+            result = m_summary.top(k);
+        }
+        for (auto& key : result)
+        {
+            key.count *= m_options.sample_rate;
+            key.error *= m_options.sample_rate;
+        }
+        return result;
+    }
+};
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#ifdef OMEGA_LOCK_STATS
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#endif
+
+namespace omega
+{
+struct stripe_stats
+{
+    std::uint64_t acquires = 0;
+    // Acquires which found the mutex taken and had to wait
+    std::uint64_t contended_acquires = 0;
+    std::uint64_t wait_ns = 0;
+    std::uint64_t hold_ns = 0;
+
+    void add(stripe_stats const& other)
+    {
+        acquires += other.acquires;
+        contended_acquires += other.contended_acquires;
+        wait_ns += other.wait_ns;
+        hold_ns += other.hold_ns;
+    }
+};
+
+// Snapshot of the stripe mutexes. Stripes are empty unless every translation unit using the table is
+// compiled with OMEGA_LOCK_STATS defined
+struct lock_stats
+{
+    std::vector<stripe_stats> stripes;
+    // Summed counters of the tables resizes replaced, threads which waited on their mutexes still add to them
+    stripe_stats retired;
+
+    stripe_stats total() const
+    {
+        stripe_stats sum;
+        for (auto const& stripe : stripes)
+        {
+            sum.add(stripe);
+        }
+        return sum;
+    }
+
+    // Counters since the table was created, they never decrease
+    stripe_stats cumulative() const
+    {
+        stripe_stats sum = total();
+        sum.add(retired);
+        return sum;
+    }
+};
+
+#ifdef OMEGA_LOCK_STATS
+// Counters of one stripe mutex on a cache line of their own. They are written only while the mutex
+// is held, atomics just let stats() read them without taking it
+struct alignas(64) stripe_counters
+{
+    std::atomic<std::uint64_t> acquires{0};
+    std::atomic<std::uint64_t> contended_acquires{0};
+    std::atomic<std::uint64_t> wait_ns{0};
+    std::atomic<std::uint64_t> hold_ns{0};
+
+    static void add(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    stripe_stats load() const
+    {
+        return stripe_stats{acquires.load(std::memory_order_relaxed), contended_acquires.load(std::memory_order_relaxed),
+                            wait_ns.load(std::memory_order_relaxed), hold_ns.load(std::memory_order_relaxed)};
+    }
+};
+
+// std::lock_guard replacement which tries the mutex first and records the wait when that fails,
+// the hold time is recorded right before unlocking
+template<typename Mutex>
+class counted_lock_guard
+{
+    using clock_type = std::chrono::steady_clock;
+
+    Mutex& m_mutex;
+    stripe_counters& m_counters;
+    clock_type::time_point m_acquired;
+
+    static std::uint64_t elapsed_ns(clock_type::time_point start, clock_type::time_point finish)
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+    }
+
+public:
+    counted_lock_guard(Mutex& mutex, stripe_counters& counters)
+        : m_mutex{mutex}
+        , m_counters{counters}
+    {
+        if (m_mutex.try_lock())
+        {
+            m_acquired = clock_type::now();
+        }
+        else
+        {
+            auto const start = clock_type::now();
+            m_mutex.lock();
+            m_acquired = clock_type::now();
+            stripe_counters::add(m_counters.contended_acquires, 1);
+            stripe_counters::add(m_counters.wait_ns, elapsed_ns(start, m_acquired));
+        }
+        stripe_counters::add(m_counters.acquires, 1);
+    }
+
+    counted_lock_guard(counted_lock_guard const& other)=delete;
+    counted_lock_guard& operator=(counted_lock_guard const& other)=delete;
+
+    ~counted_lock_guard()
+    {
+        stripe_counters::add(m_counters.hold_ns, elapsed_ns(m_acquired, clock_type::now()));
+        m_mutex.unlock();
+    }
+};
+#endif
+}
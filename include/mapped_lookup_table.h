@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "snapshot.h"
+
+namespace omega
+{
+constexpr char MAPPED_TABLE_MAGIC[8] = {'O', 'M', 'G', 'M', 'A', 'P', 'T', '\0'};
+constexpr std::uint32_t MAPPED_TABLE_VERSION = 1;
+
+// All offsets are relative to the beginning of the file
+struct mapped_table_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t slot_size;
+    std::uint64_t key_size;
+    std::uint64_t value_size;
+    std::uint64_t capacity;
+    std::uint64_t entry_count;
+    std::uint64_t slots_offset;
+};
+
+template<typename Key, typename Value>
+struct mapped_slot
+{
+    Key key;
+    Value value;
+    std::uint8_t occupied;
+};
+
+// Writes an open-addressed(linear probing) image of entries, replacing path atomically
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+void write_mapped_table(std::string const& path, std::vector<std::pair<Key, Value>> const& entries)
+{
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "mapped snapshots require trivially copyable keys and values");
+    using slot_type = mapped_slot<Key, Value>;
+
+    std::uint64_t capacity = 2;
+    while (capacity < 2 * entries.size())
+    {
+        capacity *= 2;
+    }
+
+    std::uint64_t const slots_offset = (sizeof(mapped_table_header) + 63) / 64 * 64;
+    std::uint64_t const file_size = slots_offset + capacity * sizeof(slot_type);
+    std::string const tmp_path = path + ".tmp";
+    {
+        snapshot_file file{tmp_path, O_RDWR | O_CREAT | O_TRUNC};
+        file.truncate(file_size);
+        void* data = ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file.get(), 0);
+        if (data == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "cannot map " + tmp_path);
+
+        char* const image = static_cast<char*>(data);
+        slot_type* const slots = reinterpret_cast<slot_type*>(image + slots_offset);
+        Hash hasher;
+        for (const auto& val : entries)
+        {
+            std::uint64_t index = hasher(val.first) & (capacity - 1);
+            while (slots[index].occupied)
+            {
+                index = (index + 1) & (capacity - 1);
+            }
+
+            slots[index].key = val.first;
+            slots[index].value = val.second;
+            slots[index].occupied = 1;
+        }
+
+        mapped_table_header header{};
+        std::memcpy(header.magic, MAPPED_TABLE_MAGIC, sizeof(MAPPED_TABLE_MAGIC));
+        header.version = MAPPED_TABLE_VERSION;
+        header.slot_size = sizeof(slot_type);
+        header.key_size = sizeof(Key);
+        header.value_size = sizeof(Value);
+        header.capacity = capacity;
+        header.entry_count = entries.size();
+        header.slots_offset = slots_offset;
+        std::memcpy(image, &header, sizeof(header));
+
+        int const result = ::msync(data, file_size, MS_SYNC);
+        int const error = errno;
+        ::munmap(data, file_size);
+        if (result != 0)
+            throw std::system_error(error, std::generic_category(), "cannot sync " + tmp_path);
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        throw std::system_error(errno, std::generic_category(), "cannot rename " + tmp_path);
+}
+
+// Read-only view queried in place, pages are shared with every process mapping the same file
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class mapped_lookup_table
+{
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "mapped snapshots require trivially copyable keys and values");
+    using slot_type = mapped_slot<Key, Value>;
+
+    mapped_file m_file;
+    slot_type const* m_slots = nullptr;
+    std::uint64_t m_mask = 0;
+    std::uint64_t m_size = 0;
+    Hash hasher;
+
+public:
+    explicit mapped_lookup_table(std::string const& path)
+        : m_file{path}
+    {
+        mapped_table_header header{};
+        if (m_file.size() < sizeof(header))
+            throw std::runtime_error("mapped snapshot is truncated");
+
+        std::memcpy(&header, m_file.data(), sizeof(header));
+        if (std::memcmp(header.magic, MAPPED_TABLE_MAGIC, sizeof(MAPPED_TABLE_MAGIC)) != 0)
+            throw std::runtime_error("not a mapped snapshot file");
+        if (header.version != MAPPED_TABLE_VERSION)
+            throw std::runtime_error("unsupported mapped snapshot version " + std::to_string(header.version));
+        if (header.slot_size != sizeof(slot_type) || header.key_size != sizeof(Key) || header.value_size != sizeof(Value))
+            throw std::runtime_error("mapped snapshot was written for different key or value types");
+        if (header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+            header.slots_offset % alignof(slot_type) != 0 ||
+            m_file.size() < header.slots_offset + header.capacity * sizeof(slot_type))
+            throw std::runtime_error("mapped snapshot is corrupted");
+
+        m_slots = reinterpret_cast<slot_type const*>(m_file.data() + header.slots_offset);
+        m_mask = header.capacity - 1;
+        m_size = header.entry_count;
+    }
+
+    mapped_lookup_table(mapped_lookup_table const& other)=delete;
+    mapped_lookup_table& operator=(mapped_lookup_table const& other)=delete;
+
+    std::optional<Value> get_value(Key const& key) const
+    {
+        std::uint64_t index = hasher(key) & m_mask;
+        for (std::uint64_t probe = 0; probe <= m_mask && m_slots[index].occupied; ++probe)
+        {
+            if (m_slots[index].key == key)
+                return m_slots[index].value;
+
+            index = (index + 1) & m_mask;
+        }
+
+        return std::optional<Value>{};
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+};
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "adaptive_mutex.h"
+
+namespace omega
+{
+// MCS queue lock. Waiters append a node of their own to the queue and spin on it, so a release touches
+// only the cache line of the next waiter and the lock is handed over in FIFO order. Nodes come from a
+// per-thread pool and return to it on unlock; a thread holding n mutexes at once(multiple_lock takes
+// every stripe) keeps n nodes. A waiter yields after a bounded spin, so an owner preempted on an
+// oversubscribed machine is not starved by the queue behind it
+class alignas(64) mcs_mutex
+{
+    struct alignas(64) queue_node
+    {
+        std::atomic<queue_node*> next{nullptr};
+        std::atomic_bool waiting{false};
+    };
+
+    // Free nodes linked through next
+    class node_pool
+    {
+        queue_node* m_free = nullptr;
+
+    public:
+        node_pool()=default;
+        node_pool(node_pool const& other)=delete;
+        node_pool& operator=(node_pool const& other)=delete;
+
+        ~node_pool()
+        {
+            while (m_free)
+            {
+                delete std::exchange(m_free, m_free->next.load(std::memory_order_relaxed));
+            }
+        }
+
+        queue_node* acquire()
+        {
+            if (!m_free)
+                return new queue_node;
+            return std::exchange(m_free, m_free->next.load(std::memory_order_relaxed));
+        }
+
+        void release(queue_node* node)
+        {
+            node->next.store(m_free, std::memory_order_relaxed);
+            m_free = node;
+        }
+    };
+
+    constexpr static std::uint32_t SPINS_BEFORE_YIELD = 256;
+
+    static node_pool& local_pool()
+    {
+        thread_local node_pool pool;
+        return pool;
+    }
+
+    std::atomic<queue_node*> m_tail{nullptr};
+    // Node of the current owner, only the owner reads or writes it
+    queue_node* m_owner = nullptr;
+
+    template<typename Predicate>
+    static void wait_until(Predicate predicate)
+    {
+        for (std::uint32_t spins = 0; !predicate(); ++spins)
+        {
+            if (spins < SPINS_BEFORE_YIELD)
+                cpu_relax();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+public:
+    mcs_mutex()=default;
+    mcs_mutex(mcs_mutex const& other)=delete;
+    mcs_mutex& operator=(mcs_mutex const& other)=delete;
+
+    bool try_lock()
+    {
+        queue_node* node = local_pool().acquire();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        queue_node* expected = nullptr;
+        if (m_tail.compare_exchange_strong(expected, node, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            m_owner = node;
+            return true;
+        }
+        local_pool().release(node);
+        return false;
+    }
+
+    void lock()
+    {
+        queue_node* node = local_pool().acquire();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->waiting.store(true, std::memory_order_relaxed);
+
+        queue_node* predecessor = m_tail.exchange(node, std::memory_order_acq_rel);
+        if (predecessor)
+        {
+            predecessor->next.store(node, std::memory_order_release);
+            wait_until([node] { return !node->waiting.load(std::memory_order_acquire); });
+        }
+        m_owner = node;
+    }
+
+    void unlock()
+    {
+        queue_node* node = m_owner;
+        queue_node* successor = node->next.load(std::memory_order_acquire);
+        if (!successor)
+        {
+            queue_node* expected = node;
+            if (m_tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+            {
+                local_pool().release(node);
+                return;
+            }
+            // A waiter swapped itself in as the tail but has not linked itself to this node yet
+            wait_until([node, &successor] { return (successor = node->next.load(std::memory_order_acquire)) != nullptr; });
+        }
+        successor->waiting.store(false, std::memory_order_release);
+        local_pool().release(node);
+    }
+};
+}
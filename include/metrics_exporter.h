@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "table_metrics.h"
+
+namespace omega
+{
+struct metrics_exporter_options
+{
+    std::chrono::milliseconds interval{10000};
+    // Rewritten every interval through a temporary file and rename(), as the node exporter textfile
+    // collector expects. Empty disables the file
+    std::string path;
+    // Answers every HTTP request on 127.0.0.1:port with the current metrics
+    bool serve_http = false;
+    // 0 picks a free port, see metrics_exporter::port()
+    std::uint16_t port = 0;
+    std::string prefix = "omega_lookup_table";
+};
+
+// Background thread exporting table metrics in Prometheus text format. It only calls metrics(),
+// which reads atomics and never takes a stripe mutex, so scraping does not disturb the table
+class metrics_exporter
+{
+    std::function<table_metrics()> m_source;
+    metrics_exporter_options m_options;
+    int m_listen_fd = -1;
+    std::atomic_bool m_stop{false};
+    std::thread m_thread;
+
+    std::string format() const
+    {
+        return format_prometheus(m_source(), m_options.prefix);
+    }
+
+    void write_file() const
+    {
+        std::string const text = format();
+        std::string const temporary = m_options.path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+            return;
+
+        bool const written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (std::fclose(file) == 0 && written)
+            std::rename(temporary.c_str(), m_options.path.c_str());
+        else
+            std::remove(temporary.c_str());
+    }
+
+    void answer(int fd) const
+    {
+        // The request itself does not matter, it is read only so that the client sees a clean close
+        timeval const timeout{1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[4096];
+        ::recv(fd, request, sizeof(request), 0);
+
+        std::string const body = format();
+        std::string const response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                     std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        std::size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t const result = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (result <= 0)
+                break;
+            sent += std::size_t(result);
+        }
+        ::close(fd);
+    }
+
+    void run()
+    {
+        using clock_type = std::chrono::steady_clock;
+        // Short poll slices keep the destructor from waiting a whole interval
+        constexpr std::chrono::milliseconds slice{100};
+        auto next_write = clock_type::now();
+        while (!m_stop.load(std::memory_order_relaxed))
+        {
+            auto const now = clock_type::now();
+            if (!m_options.path.empty() && now >= next_write)
+            {
+                write_file();
+                next_write = now + m_options.interval;
+            }
+
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_write - clock_type::now());
+            wait = std::max(std::chrono::milliseconds{0}, std::min(wait, slice));
+            if (m_options.path.empty())
+                wait = slice;
+
+            if (m_listen_fd < 0)
+            {
+                std::this_thread::sleep_for(wait);
+                continue;
+            }
+
+            pollfd listen{m_listen_fd, POLLIN, 0};
+            if (::poll(&listen, 1, int(wait.count())) > 0 && (listen.revents & POLLIN))
+            {
+                int const fd = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                    answer(fd);
+            }
+        }
+    }
+
+    void listen_loopback()
+    {
+        m_listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_listen_fd < 0)
+            throw std::system_error(errno, std::generic_category(), "cannot create metrics socket");
+
+        int const reuse = 1;
+        ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(m_options.port);
+        socklen_t size = sizeof(address);
+        if (::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(m_listen_fd, 16) != 0 ||
+            ::getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+        {
+            int const error = errno;
+            ::close(m_listen_fd);
+            throw std::system_error(error, std::generic_category(), "cannot listen on metrics port " + std::to_string(m_options.port));
+        }
+        m_options.port = ntohs(address.sin_port);
+    }
+
+public:
+    // The table must outlive the exporter
+    template<typename Table>
+    metrics_exporter(Table const& table, metrics_exporter_options options)
+        : m_source{[&table] { return table.metrics(); }}
+        , m_options{std::move(options)}
+    {
+        if (m_options.serve_http)
+            listen_loopback();
+        m_thread = std::thread{[this] { run(); }};
+    }
+
+    metrics_exporter(metrics_exporter const& other)=delete;
+    metrics_exporter& operator=(metrics_exporter const& other)=delete;
+
+    ~metrics_exporter()
+    {
+        m_stop.store(true, std::memory_order_relaxed);
+        m_thread.join();
+        if (m_listen_fd >= 0)
+            ::close(m_listen_fd);
+    }
+
+    // Port the HTTP endpoint listens on, 0 if it is disabled
+    std::uint16_t port() const
+    {
+        return m_options.serve_http ? m_options.port : 0;
+    }
+};
+}
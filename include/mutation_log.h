@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "per_thread.h"
+#include "snapshot.h"
+
+namespace omega
+{
+enum class log_sync_policy
+{
+    none,           // leave write back to the OS
+    every_flush,    // fsync after every group commit
+    interval        // fsync at most once per sync_interval
+};
+
+struct mutation_log_options
+{
+    std::chrono::milliseconds flush_interval{10};
+    log_sync_policy sync_policy = log_sync_policy::every_flush;
+    std::chrono::milliseconds sync_interval{1000};
+};
+
+enum class log_operation : std::uint8_t
+{
+    add_or_update = 1,
+    remove = 2
+};
+
+template<typename Key, typename Value>
+struct log_record
+{
+    std::uint64_t lsn;
+    log_operation operation;
+    Key key;
+    std::optional<Value> value;
+};
+
+// Record layout: u32 payload size, u64 lsn, u8 operation, key, value(add_or_update only)
+template<typename Key, typename Value>
+bool read_log_record(char const*& cursor, char const* end, log_record<Key, Value>& record)
+{
+    std::uint32_t size = 0;
+    char const* payload = cursor;
+    if (!snapshot_serializer<std::uint32_t>::read(payload, end, size) || std::size_t(end - payload) < size)
+        return false;
+
+    char const* const payload_end = payload + size;
+    std::uint8_t operation = 0;
+    if (!snapshot_serializer<std::uint64_t>::read(payload, payload_end, record.lsn) ||
+        !snapshot_serializer<std::uint8_t>::read(payload, payload_end, operation) ||
+        !snapshot_serializer<Key>::read(payload, payload_end, record.key))
+        return false;
+
+    record.operation = log_operation{operation};
+    record.value.reset();
+    if (record.operation == log_operation::add_or_update)
+    {
+        Value value;
+        if (!snapshot_serializer<Value>::read(payload, payload_end, value))
+            return false;
+        record.value = std::move(value);
+    }
+    else if (record.operation != log_operation::remove)
+    {
+        return false;
+    }
+
+    cursor = payload_end;
+    return true;
+}
+
+// Records are read until the first torn or corrupted one, which ends the usable log
+template<typename Key, typename Value>
+std::vector<log_record<Key, Value>> read_log_records(std::string const& path)
+{
+    std::vector<log_record<Key, Value>> records;
+    mapped_file file{path};
+    char const* cursor = file.data();
+    char const* const end = file.data() + file.size();
+    log_record<Key, Value> record{};
+    while (cursor != end && read_log_record(cursor, end, record))
+    {
+        records.push_back(std::move(record));
+    }
+
+    return records;
+}
+
+// Applies records in lsn order starting at from_lsn and stops at the first missing lsn,
+// so the table always ends up in a state which existed before the crash. Returns the next lsn
+template<typename Key, typename Value, typename Table>
+std::uint64_t replay_mutation_log(std::string const& path, Table& table, std::uint64_t from_lsn = 0)
+{
+    auto records = read_log_records<Key, Value>(path);
+    std::sort(records.begin(), records.end(),
+              [](log_record<Key, Value> const& lhs, log_record<Key, Value> const& rhs)
+              { return lhs.lsn < rhs.lsn; });
+
+    std::uint64_t next_lsn = from_lsn;
+    for (const auto& record : records)
+    {
+        if (record.lsn < next_lsn)
+            continue;
+        if (record.lsn != next_lsn)
+            break;
+
+        if (record.operation == log_operation::add_or_update)
+            table.add_or_update(record.key, record.value.value());
+        else
+            table.remove(record.key);
+        ++next_lsn;
+    }
+
+    return next_lsn;
+}
+
+// What the table appends through. Keeps serializer requirements out of tables which never attach a log
+template<typename Key, typename Value>
+class mutation_sink
+{
+public:
+    virtual ~mutation_sink() = default;
+    virtual std::uint64_t append_update(Key const& key, Value const& value) = 0;
+    virtual std::uint64_t append_remove(Key const& key) = 0;
+    virtual std::uint64_t next_lsn() const = 0;
+};
+
+// Write-ahead log of table mutations. Writers append to their own buffer under an uncontended mutex,
+// a group commit thread collects the buffers and writes them with a single write call
+template<typename Key, typename Value>
+class mutation_log : public mutation_sink<Key, Value>
+{
+    struct thread_buffer
+    {
+        std::mutex mutex;
+        std::vector<char> data;
+    };
+
+    std::uint64_t m_recovered_lsn;
+    snapshot_file m_file;
+    mutation_log_options m_options;
+    std::atomic<std::uint64_t> m_next_lsn;
+    // Every record below it is on stable storage
+    std::atomic<std::uint64_t> m_durable_lsn;
+    per_thread<thread_buffer> m_buffers;
+    std::mutex m_flush_mutex;
+    std::uint64_t m_offset;
+    std::chrono::steady_clock::time_point m_last_sync;
+
+    std::mutex m_commit_mutex;
+    std::condition_variable m_commit_wakeup;
+    bool m_stop = false;
+    std::thread m_commit_thread;
+
+    // Group commit writes per-thread buffers in any order, so a crash can leave lsn n + 1 on disk without n.
+    // Replay stops at such a gap, records numbered after it would never be recovered. Rewrites the log to the
+    // records below the first missing lsn(dropping a torn tail as well) and returns that lsn
+    static std::uint64_t repair(std::string const& path)
+    {
+        std::vector<std::pair<std::uint64_t, std::pair<std::size_t, std::size_t>>> records;
+        std::vector<char> kept;
+        std::uint64_t next_lsn = 0;
+        bool rewrite = false;
+        snapshot_file{path, O_RDWR | O_CREAT};
+        {
+            mapped_file file{path};
+            char const* cursor = file.data();
+            char const* const end = file.data() + file.size();
+            log_record<Key, Value> record{};
+            while (cursor != end)
+            {
+                char const* const start = cursor;
+                if (!read_log_record(cursor, end, record))
+                    break;
+                records.emplace_back(record.lsn, std::make_pair(std::size_t(start - file.data()), std::size_t(cursor - start)));
+            }
+            rewrite = cursor != end;
+
+            std::vector<std::uint64_t> lsns;
+            for (auto const& entry : records)
+            {
+                lsns.push_back(entry.first);
+            }
+            std::sort(lsns.begin(), lsns.end());
+            for (std::uint64_t lsn : lsns)
+            {
+                if (lsn == next_lsn)
+                    ++next_lsn;
+                else if (lsn > next_lsn)
+                    break;
+            }
+
+            for (auto const& entry : records)
+            {
+                if (entry.first < next_lsn)
+                    kept.insert(kept.end(), file.data() + entry.second.first, file.data() + entry.second.first + entry.second.second);
+                else
+                    rewrite = true;
+            }
+        }
+
+        if (rewrite)
+        {
+            // Through a temporary file, a crash while repairing leaves either log intact
+            std::string const temporary = path + ".repair";
+            {
+                snapshot_file file{temporary, O_WRONLY | O_CREAT | O_TRUNC};
+                file.write_at(kept.data(), kept.size(), 0);
+                file.sync();
+            }
+            if (std::rename(temporary.c_str(), path.c_str()) != 0)
+                throw std::system_error(errno, std::generic_category(), "cannot replace " + path);
+        }
+        return next_lsn;
+    }
+
+    // Moves everything buffered so far to the file, m_flush_mutex must be held. Returns an lsn
+    // such that every record below it has been written
+    std::uint64_t write_pending()
+    {
+        // Appenders hold their buffer mutex from taking an lsn until the record is buffered, so every
+        // lsn below this one is collected by the walk over the buffers that follows
+        std::uint64_t const covered = m_next_lsn.load(std::memory_order_acquire);
+        std::vector<char> pending;
+        std::vector<char> swapped;
+        m_buffers.for_each([&pending, &swapped](thread_buffer& buffer)
+        {
+            {
+                std::lock_guard<std::mutex> lock{buffer.mutex};
+                if (buffer.data.empty())
+                    return;
+                swapped.swap(buffer.data);
+            }
+            pending.insert(pending.end(), swapped.begin(), swapped.end());
+            swapped.clear();
+        });
+
+        if (!pending.empty())
+        {
+            m_file.write_at(pending.data(), pending.size(), m_offset);
+            m_offset += pending.size();
+        }
+        return covered;
+    }
+
+    void sync_written(std::uint64_t covered)
+    {
+        m_file.sync();
+        m_last_sync = std::chrono::steady_clock::now();
+        if (covered > m_durable_lsn.load(std::memory_order_relaxed))
+            m_durable_lsn.store(covered, std::memory_order_release);
+    }
+
+    template<typename Func>
+    std::uint64_t append(log_operation operation, Key const& key, Func write_value)
+    {
+        thread_buffer& buffer = m_buffers.local();
+        std::lock_guard<std::mutex> lock{buffer.mutex};
+        std::uint64_t const lsn = m_next_lsn.fetch_add(1, std::memory_order_relaxed);
+        std::size_t const start = buffer.data.size();
+        snapshot_serializer<std::uint32_t>::write(buffer.data, 0);
+        snapshot_serializer<std::uint64_t>::write(buffer.data, lsn);
+        snapshot_serializer<std::uint8_t>::write(buffer.data, std::uint8_t(operation));
+        snapshot_serializer<Key>::write(buffer.data, key);
+        write_value(buffer.data);
+
+        std::uint32_t const size = std::uint32_t(buffer.data.size() - start - sizeof(std::uint32_t));
+        std::memcpy(buffer.data.data() + start, &size, sizeof(size));
+        return lsn;
+    }
+
+    void commit_loop()
+    {
+        std::unique_lock<std::mutex> lock{m_commit_mutex};
+        while (!m_stop)
+        {
+            m_commit_wakeup.wait_for(lock, m_options.flush_interval);
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+public:
+    explicit mutation_log(std::string const& path, mutation_log_options options = {})
+        : m_recovered_lsn{repair(path)}
+        , m_file{path, O_RDWR | O_CREAT}
+        , m_options{options}
+        , m_next_lsn{m_recovered_lsn}
+        , m_durable_lsn{m_recovered_lsn}
+        , m_offset{m_file.size()}
+        , m_last_sync{std::chrono::steady_clock::now()}
+    {
+        m_commit_thread = std::thread{[this] { commit_loop(); }};
+    }
+
+    ~mutation_log() override
+    {
+        {
+            std::lock_guard<std::mutex> lock{m_commit_mutex};
+            m_stop = true;
+            m_commit_wakeup.notify_one();
+        }
+        m_commit_thread.join();
+        flush();
+    }
+
+    mutation_log(mutation_log const& other)=delete;
+    mutation_log& operator=(mutation_log const& other)=delete;
+
+    std::uint64_t append_update(Key const& key, Value const& value) override
+    {
+        return append(log_operation::add_or_update, key,
+                      [&value](std::vector<char>& out) { snapshot_serializer<Value>::write(out, value); });
+    }
+
+    std::uint64_t append_remove(Key const& key) override
+    {
+        return append(log_operation::remove, key, [](std::vector<char>&) {});
+    }
+
+    // Lsn which the next appended record gets, every record below it has already been buffered
+    std::uint64_t next_lsn() const override
+    {
+        return m_next_lsn.load(std::memory_order_relaxed);
+    }
+
+    // Writes out everything buffered so far, fsync follows the configured policy
+    void flush()
+    {
+        std::lock_guard<std::mutex> flush_lock{m_flush_mutex};
+        std::uint64_t const covered = write_pending();
+        auto const now = std::chrono::steady_clock::now();
+        if (m_options.sync_policy == log_sync_policy::every_flush ||
+            (m_options.sync_policy == log_sync_policy::interval && now - m_last_sync >= m_options.sync_interval))
+            sync_written(covered);
+    }
+
+    void sync()
+    {
+        std::lock_guard<std::mutex> flush_lock{m_flush_mutex};
+        sync_written(write_pending());
+    }
+
+    // Lsn below which every record is on stable storage
+    std::uint64_t durable_lsn() const
+    {
+        return m_durable_lsn.load(std::memory_order_acquire);
+    }
+
+    // Returns once the record with this lsn, as returned by an append, and every record before it are
+    // on stable storage. Writes and fsyncs right away instead of waiting for the group commit
+    void wait_durable(std::uint64_t lsn)
+    {
+        if (durable_lsn() > lsn)
+            return;
+        sync();
+    }
+};
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace omega
+{
+inline std::atomic<std::uint64_t> per_thread_next_id{1};
+
+// One T per thread which touched the object. Slots live as long as the object itself,
+// so values written by threads which already exited are still visible to for_each
+template<typename T>
+class per_thread
+{
+    std::uint64_t const m_id;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<T>> m_slots;
+
+    struct thread_cache
+    {
+        std::uint64_t last_id = 0;
+        T* last_slot = nullptr;
+        std::unordered_map<std::uint64_t, T*> slots;
+    };
+
+public:
+    per_thread()
+        : m_id{per_thread_next_id.fetch_add(1, std::memory_order_relaxed)}
+    {}
+
+    per_thread(per_thread const& other)=delete;
+    per_thread& operator=(per_thread const& other)=delete;
+
+    T& local()
+    {
+        thread_local thread_cache cache;
+        if (cache.last_id == m_id)
+            return *cache.last_slot;
+
+        auto found = cache.slots.find(m_id);
+        T* slot = nullptr;
+        if (found != cache.slots.end())
+        {
+            slot = found->second;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_slots.push_back(std::make_unique<T>());
+            slot = m_slots.back().get();
+            cache.slots.emplace(m_id, slot);
+        }
+
+        cache.last_id = m_id;
+        cache.last_slot = slot;
+        return *slot;
+    }
+
+    template<typename Func>
+    void for_each(Func func)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        for (auto& slot : m_slots)
+        {
+            func(*slot);
+        }
+    }
+};
+}
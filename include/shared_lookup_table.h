@@ -0,0 +1,351 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace omega
+{
+constexpr char SHARED_TABLE_MAGIC[8] = {'O', 'M', 'G', 'S', 'H', 'M', 'T', '\0'};
+constexpr std::uint32_t SHARED_TABLE_VERSION = 2;
+
+// Hash table living in a POSIX shared memory segment, used by several processes at once.
+// Everything in the segment is addressed by offsets or node indices, so every process may map it
+// at a different address. Stripes are guarded by robust process-shared mutexes, nodes come from a
+// fixed pool: a bump index shared by everyone plus one free list of removed nodes, so a stripe can
+// reuse nodes which any other stripe released
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class shared_lookup_table
+{
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "shared memory tables require trivially copyable keys and values");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+                  "shared memory tables require address free atomics");
+
+    constexpr static std::uint64_t NULL_NODE = 0;
+    constexpr static std::uint32_t STATE_READY = 1;
+
+    struct segment_header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::atomic<std::uint32_t> state;
+        std::uint64_t key_size;
+        std::uint64_t value_size;
+        std::uint64_t buckets_count;
+        std::uint64_t locks_count;
+        std::uint64_t budget;
+        std::uint64_t nodes_capacity;
+        std::uint64_t locks_offset;
+        std::uint64_t buckets_offset;
+        std::uint64_t nodes_offset;
+        std::uint64_t segment_size;
+        std::atomic<std::uint64_t> next_node;
+        // Guards changes of free_list, taken after a stripe mutex and never the other way round.
+        // free_list is read without it to skip the mutex while the list is empty
+        pthread_mutex_t pool_mutex;
+        std::atomic<std::uint64_t> free_list;
+    };
+
+    struct alignas(64) stripe_type
+    {
+        pthread_mutex_t mutex;
+    };
+
+    // Node indices start at 1, 0 terminates chains and free lists
+    struct node_type
+    {
+        std::uint64_t next;
+        Key key;
+        Value value;
+    };
+
+    class robust_lock
+    {
+        pthread_mutex_t* m_mutex;
+
+    public:
+        explicit robust_lock(pthread_mutex_t& mutex)
+            : m_mutex{&mutex}
+        {
+            int const result = ::pthread_mutex_lock(m_mutex);
+            // Chains and the free list are updated with single stores, so a dead owner leaves at most
+            // a leaked node behind
+            if (result == EOWNERDEAD)
+                ::pthread_mutex_consistent(m_mutex);
+            else if (result != 0)
+                throw std::system_error(result, std::generic_category(), "cannot lock shared mutex");
+        }
+
+        ~robust_lock()
+        {
+            ::pthread_mutex_unlock(m_mutex);
+        }
+
+        robust_lock(robust_lock const& other)=delete;
+        robust_lock& operator=(robust_lock const& other)=delete;
+    };
+
+    std::string m_name;
+    char* m_segment = nullptr;
+    std::size_t m_size = 0;
+    segment_header* m_header = nullptr;
+    stripe_type* m_stripes = nullptr;
+    std::uint64_t* m_buckets = nullptr;
+    node_type* m_nodes = nullptr;
+    Hash hasher;
+
+    static std::uint64_t align(std::uint64_t offset)
+    {
+        return (offset + 63) / 64 * 64;
+    }
+
+    void map(int fd, std::size_t size)
+    {
+        void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "cannot map " + m_name);
+
+        m_segment = static_cast<char*>(data);
+        m_size = size;
+        m_header = reinterpret_cast<segment_header*>(m_segment);
+    }
+
+    void bind()
+    {
+        m_stripes = reinterpret_cast<stripe_type*>(m_segment + m_header->locks_offset);
+        m_buckets = reinterpret_cast<std::uint64_t*>(m_segment + m_header->buckets_offset);
+        m_nodes = reinterpret_cast<node_type*>(m_segment + m_header->nodes_offset) - 1;
+    }
+
+    void create(int fd, std::size_t concurrency, std::size_t capacity, std::size_t max_entries)
+    {
+        std::uint64_t const locks_offset = align(sizeof(segment_header));
+        std::uint64_t const buckets_offset = locks_offset + concurrency * sizeof(stripe_type);
+        std::uint64_t const nodes_offset = align(buckets_offset + capacity * sizeof(std::uint64_t));
+        std::uint64_t const size = nodes_offset + max_entries * sizeof(node_type);
+        if (::ftruncate(fd, off_t(size)) != 0)
+            throw std::system_error(errno, std::generic_category(), "cannot size " + m_name);
+
+        map(fd, size);
+        std::memcpy(m_header->magic, SHARED_TABLE_MAGIC, sizeof(SHARED_TABLE_MAGIC));
+        m_header->version = SHARED_TABLE_VERSION;
+        m_header->key_size = sizeof(Key);
+        m_header->value_size = sizeof(Value);
+        m_header->buckets_count = capacity;
+        m_header->locks_count = concurrency;
+        m_header->budget = std::uint64_t(std::ceil(double(capacity) / concurrency));
+        m_header->nodes_capacity = max_entries;
+        m_header->locks_offset = locks_offset;
+        m_header->buckets_offset = buckets_offset;
+        m_header->nodes_offset = nodes_offset;
+        m_header->segment_size = size;
+        m_header->next_node.store(1, std::memory_order_relaxed);
+        m_header->free_list.store(NULL_NODE, std::memory_order_relaxed);
+        bind();
+
+        pthread_mutexattr_t attributes;
+        ::pthread_mutexattr_init(&attributes);
+        ::pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        ::pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        ::pthread_mutex_init(&m_header->pool_mutex, &attributes);
+        for (std::size_t i = 0; i < concurrency; ++i)
+        {
+            ::pthread_mutex_init(&m_stripes[i].mutex, &attributes);
+        }
+        ::pthread_mutexattr_destroy(&attributes);
+
+        m_header->state.store(STATE_READY, std::memory_order_release);
+    }
+
+    void attach(int fd, std::chrono::milliseconds timeout)
+    {
+        // The creator may still be sizing or initializing the segment. One which died meanwhile never
+        // finishes, so the wait is bounded and the segment has to be unlinked and created again
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        auto const wait = [this, deadline]
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                throw std::runtime_error(m_name + " was not initialized in time, its creator may have died");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        };
+
+        struct stat info{};
+        for(;;)
+        {
+            if (::fstat(fd, &info) != 0)
+                throw std::system_error(errno, std::generic_category(), "cannot stat " + m_name);
+            if (std::size_t(info.st_size) >= sizeof(segment_header))
+                break;
+            wait();
+        }
+
+        map(fd, std::size_t(info.st_size));
+        while (m_header->state.load(std::memory_order_acquire) != STATE_READY)
+        {
+            wait();
+        }
+
+        if (std::memcmp(m_header->magic, SHARED_TABLE_MAGIC, sizeof(SHARED_TABLE_MAGIC)) != 0 ||
+            m_header->version != SHARED_TABLE_VERSION)
+            throw std::runtime_error(m_name + " is not a shared lookup table");
+        if (m_header->key_size != sizeof(Key) || m_header->value_size != sizeof(Value))
+            throw std::runtime_error(m_name + " was created for different key or value types");
+        if (m_header->segment_size > m_size)
+            throw std::runtime_error(m_name + " is truncated");
+
+        bind();
+    }
+
+    std::size_t get_bucket_index(Key const& key) const
+    {
+        return hasher(key) % m_header->buckets_count;
+    }
+
+    stripe_type& get_stripe(std::size_t bucket_index) const
+    {
+        return m_stripes[bucket_index / m_header->budget];
+    }
+
+    std::uint64_t allocate_node()
+    {
+        if (m_header->free_list.load(std::memory_order_relaxed) != NULL_NODE)
+        {
+            robust_lock const lock{m_header->pool_mutex};
+            std::uint64_t const node = m_header->free_list.load(std::memory_order_relaxed);
+            if (node != NULL_NODE)
+            {
+                m_header->free_list.store(m_nodes[node].next, std::memory_order_relaxed);
+                return node;
+            }
+        }
+
+        std::uint64_t const node = m_header->next_node.fetch_add(1, std::memory_order_relaxed);
+        if (node > m_header->nodes_capacity)
+        {
+            m_header->next_node.fetch_sub(1, std::memory_order_relaxed);
+            throw std::length_error(m_name + " is full");
+        }
+
+        return node;
+    }
+
+    void free_node(std::uint64_t node)
+    {
+        robust_lock const lock{m_header->pool_mutex};
+        m_nodes[node].next = m_header->free_list.load(std::memory_order_relaxed);
+        m_header->free_list.store(node, std::memory_order_relaxed);
+    }
+
+public:
+    // Creates the segment or attaches to an existing one. concurrency, capacity and max_entries
+    // are only used by the creating process, attach_timeout only by attaching ones
+    shared_lookup_table(std::string const& name, std::size_t concurrency, std::size_t capacity, std::size_t max_entries,
+                        std::chrono::milliseconds attach_timeout = std::chrono::seconds{10})
+        : m_name{name}
+    {
+        concurrency = std::max<std::size_t>(concurrency, 1);
+        capacity = std::max(capacity, concurrency);
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        bool const created = fd >= 0;
+        if (!created && errno == EEXIST)
+            fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "cannot open shared memory " + name);
+
+        try
+        {
+            if (created)
+                create(fd, concurrency, capacity, max_entries);
+            else
+                attach(fd, attach_timeout);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            if (m_segment)
+                ::munmap(m_segment, m_size);
+            throw;
+        }
+        ::close(fd);
+    }
+
+    ~shared_lookup_table()
+    {
+        ::munmap(m_segment, m_size);
+    }
+
+    shared_lookup_table(shared_lookup_table const& other)=delete;
+    shared_lookup_table& operator=(shared_lookup_table const& other)=delete;
+
+    // The segment stays alive until every process unmapped it
+    static void unlink(std::string const& name)
+    {
+        ::shm_unlink(name.c_str());
+    }
+
+    std::optional<Value> get_value(Key const& key) const
+    {
+        std::size_t const bucket_index = get_bucket_index(key);
+        robust_lock const lock{get_stripe(bucket_index).mutex};
+        for (std::uint64_t node = m_buckets[bucket_index]; node != NULL_NODE; node = m_nodes[node].next)
+        {
+            if (m_nodes[node].key == key)
+                return m_nodes[node].value;
+        }
+
+        return std::optional<Value>{};
+    }
+
+    void add_or_update(Key const& key, Value const& value)
+    {
+        std::size_t const bucket_index = get_bucket_index(key);
+        robust_lock const lock{get_stripe(bucket_index).mutex};
+        for (std::uint64_t node = m_buckets[bucket_index]; node != NULL_NODE; node = m_nodes[node].next)
+        {
+            if (m_nodes[node].key == key)
+            {
+                m_nodes[node].value = value;
+                return;
+            }
+        }
+
+        std::uint64_t const node = allocate_node();
+        m_nodes[node].key = key;
+        m_nodes[node].value = value;
+        m_nodes[node].next = m_buckets[bucket_index];
+        m_buckets[bucket_index] = node;
+    }
+
+    void remove(Key const& key)
+    {
+        std::size_t const bucket_index = get_bucket_index(key);
+        robust_lock const lock{get_stripe(bucket_index).mutex};
+        std::uint64_t* link = &m_buckets[bucket_index];
+        for (std::uint64_t node = *link; node != NULL_NODE; link = &m_nodes[node].next, node = *link)
+        {
+            if (m_nodes[node].key == key)
+            {
+                *link = m_nodes[node].next;
+                free_node(node);
+                return;
+            }
+        }
+    }
+};
+}
@@ -0,0 +1,601 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+
+namespace omega
+{
+// Specialize for types which are neither trivially copyable nor std::string
+template<typename T, typename Enable = void>
+struct snapshot_serializer;
+
+template<typename T>
+struct snapshot_serializer<T, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+{
+    static void write(std::vector<char>& out, T const& value)
+    {
+        char const* bytes = reinterpret_cast<char const*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    static bool read(char const*& cursor, char const* end, T& value)
+    {
+        if (std::size_t(end - cursor) < sizeof(T))
+            return false;
+
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+};
+
+template<>
+struct snapshot_serializer<std::string>
+{
+    static void write(std::vector<char>& out, std::string const& value)
+    {
+        snapshot_serializer<std::uint64_t>::write(out, value.size());
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    static bool read(char const*& cursor, char const* end, std::string& value)
+    {
+        std::uint64_t size = 0;
+        if (!snapshot_serializer<std::uint64_t>::read(cursor, end, size) ||
+            std::uint64_t(end - cursor) < size)
+            return false;
+
+        value.assign(cursor, size);
+        cursor += size;
+        return true;
+    }
+};
+
+constexpr char SNAPSHOT_MAGIC[8] = {'O', 'M', 'G', 'S', 'N', 'A', 'P', '\0'};
+constexpr std::uint32_t SNAPSHOT_VERSION = 3;
+constexpr std::size_t SNAPSHOT_ALIGNMENT = 4096;
+
+// Version 1 files end the header right before log_lsn, version 2 files right before chunk_count.
+// Version 3 files continue with chunk_count snapshot_chunk entries, chunk data starts aligned
+struct snapshot_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t entry_count;
+    std::uint64_t log_lsn;
+    std::uint64_t chunk_count;
+    std::uint32_t directory_crc;
+    std::uint32_t reserved;
+};
+
+constexpr std::size_t SNAPSHOT_V1_HEADER_SIZE = offsetof(snapshot_header, log_lsn);
+constexpr std::size_t SNAPSHOT_V2_HEADER_SIZE = offsetof(snapshot_header, chunk_count);
+
+struct snapshot_chunk
+{
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint64_t entry_count;
+    std::uint32_t crc;
+    std::uint32_t reserved;
+};
+
+struct snapshot_options
+{
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    // Requires a file system supporting O_DIRECT, tmpfs for example does not
+    bool direct_io = false;
+};
+
+struct snapshot_info
+{
+    std::uint64_t entry_count;
+    // Mutation log records from this lsn on have to be replayed on top of the snapshot
+    std::uint64_t log_lsn;
+};
+
+inline snapshot_header make_snapshot_header(snapshot_info info)
+{
+    snapshot_header header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.entry_count = info.entry_count;
+    header.log_lsn = info.log_lsn;
+    return header;
+}
+
+inline std::size_t snapshot_header_size(snapshot_header const& header)
+{
+    switch (header.version)
+    {
+    case 1:
+        return SNAPSHOT_V1_HEADER_SIZE;
+    case 2:
+        return SNAPSHOT_V2_HEADER_SIZE;
+    default:
+        return sizeof(snapshot_header);
+    }
+}
+
+inline std::uint64_t align_snapshot_offset(std::uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+// Zero-filled buffer usable for O_DIRECT transfers
+class aligned_buffer
+{
+    std::unique_ptr<char, decltype(&std::free)> m_data{nullptr, &std::free};
+    std::size_t m_size = 0;
+
+public:
+    void resize(std::size_t size)
+    {
+        size = align_snapshot_offset(size);
+        if (size > m_size)
+        {
+            m_data.reset(static_cast<char*>(std::aligned_alloc(SNAPSHOT_ALIGNMENT, size)));
+            if (!m_data)
+                throw std::bad_alloc{};
+            m_size = size;
+        }
+        std::memset(m_data.get(), 0, size);
+    }
+
+    char* data()
+    {
+        return m_data.get();
+    }
+};
+
+class snapshot_file
+{
+    int m_fd;
+
+public:
+    snapshot_file(std::string const& path, int flags, mode_t mode = 0644)
+        : m_fd{::open(path.c_str(), flags | O_CLOEXEC, mode)}
+    {
+        if (m_fd < 0)
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+    }
+
+    ~snapshot_file()
+    {
+        ::close(m_fd);
+    }
+
+    snapshot_file(snapshot_file const& other)=delete;
+    snapshot_file& operator=(snapshot_file const& other)=delete;
+
+    int get() const
+    {
+        return m_fd;
+    }
+
+    void write_at(void const* data, std::size_t size, std::uint64_t offset)
+    {
+        char const* bytes = static_cast<char const*>(data);
+        while (size > 0)
+        {
+            ssize_t written = ::pwrite(m_fd, bytes, size, off_t(offset));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "snapshot write failed");
+            }
+
+            bytes += written;
+            size -= std::size_t(written);
+            offset += std::uint64_t(written);
+        }
+    }
+
+    void read_at(void* data, std::size_t size, std::uint64_t offset) const
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            ssize_t result = ::pread(m_fd, bytes, size, off_t(offset));
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "snapshot read failed");
+            }
+            if (result == 0)
+                throw std::runtime_error("snapshot is truncated");
+
+            bytes += result;
+            size -= std::size_t(result);
+            offset += std::uint64_t(result);
+        }
+    }
+
+    // Like read_at, but stops early at the end of the file. Returns the number of bytes read
+    std::size_t read_up_to(void* data, std::size_t size, std::uint64_t offset) const
+    {
+        char* bytes = static_cast<char*>(data);
+        std::size_t total = 0;
+        while (total < size)
+        {
+            ssize_t result = ::pread(m_fd, bytes + total, size - total, off_t(offset + total));
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "snapshot read failed");
+            }
+            if (result == 0)
+                break;
+            total += std::size_t(result);
+        }
+        return total;
+    }
+
+    std::uint64_t size() const
+    {
+        struct stat info{};
+        if (::fstat(m_fd, &info) != 0)
+            throw std::system_error(errno, std::generic_category(), "cannot stat snapshot");
+        return std::uint64_t(info.st_size);
+    }
+
+    void truncate(std::uint64_t size)
+    {
+        if (::ftruncate(m_fd, off_t(size)) != 0)
+            throw std::system_error(errno, std::generic_category(), "snapshot truncate failed");
+    }
+
+    void sync()
+    {
+        if (::fsync(m_fd) != 0)
+            throw std::system_error(errno, std::generic_category(), "snapshot fsync failed");
+    }
+};
+
+class mapped_file
+{
+    char const* m_data = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    explicit mapped_file(std::string const& path)
+    {
+        snapshot_file file{path, O_RDONLY};
+        struct stat info{};
+        if (::fstat(file.get(), &info) != 0)
+            throw std::system_error(errno, std::generic_category(), "cannot stat " + path);
+
+        m_size = std::size_t(info.st_size);
+        if (m_size == 0)
+            return;
+
+        void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, file.get(), 0);
+        if (data == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "cannot map " + path);
+
+        m_data = static_cast<char const*>(data);
+    }
+
+    ~mapped_file()
+    {
+        if (m_data)
+            ::munmap(const_cast<char*>(m_data), m_size);
+    }
+
+    mapped_file(mapped_file const& other)=delete;
+    mapped_file& operator=(mapped_file const& other)=delete;
+
+    char const* data() const
+    {
+        return m_data;
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+};
+
+// Reads the first block through an aligned buffer, so the file may be opened with O_DIRECT
+inline snapshot_header read_snapshot_header(snapshot_file const& file)
+{
+    aligned_buffer head;
+    head.resize(SNAPSHOT_ALIGNMENT);
+    std::size_t const size = file.read_up_to(head.data(), SNAPSHOT_ALIGNMENT, 0);
+    if (size < SNAPSHOT_V1_HEADER_SIZE)
+        throw std::runtime_error("not a snapshot file");
+
+    snapshot_header header{};
+    std::memcpy(&header, head.data(), SNAPSHOT_V1_HEADER_SIZE);
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+        throw std::runtime_error("not a snapshot file");
+    if (header.version == 0 || header.version > SNAPSHOT_VERSION)
+        throw std::runtime_error("unsupported snapshot version " + std::to_string(header.version));
+    if (size < snapshot_header_size(header))
+        throw std::runtime_error("snapshot is truncated");
+
+    std::memcpy(&header, head.data(), snapshot_header_size(header));
+    return header;
+}
+
+// A single worker runs on the calling thread, which keeps a forked child free of new threads
+template<typename Func>
+void run_snapshot_workers(std::size_t threads, Func func)
+{
+    if (threads <= 1)
+    {
+        func();
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(std::max<std::size_t>(threads, 1));
+    for (std::size_t i = 0; i < errors.size(); ++i)
+    {
+        workers.emplace_back([&func, &error = errors[i]]()
+        {
+            try
+            {
+                func();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    for (auto& error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+// Every worker serializes whole chunks, checksums them and writes each one with a single aligned pwrite.
+// serialize(chunk, buffer, entry_count) returns false when the source changed and the write has to restart
+template<typename SerializeFunc>
+bool write_chunked_snapshot(snapshot_file& file, std::size_t chunk_count, snapshot_options const& options,
+                            std::uint64_t log_lsn, SerializeFunc serialize, snapshot_info& info)
+{
+    std::size_t const directory_size = chunk_count * sizeof(snapshot_chunk);
+    std::uint64_t const data_offset = align_snapshot_offset(sizeof(snapshot_header) + directory_size);
+    std::vector<snapshot_chunk> directory(chunk_count);
+    std::atomic<std::size_t> next_chunk{0};
+    std::atomic<std::uint64_t> next_offset{data_offset};
+    std::atomic<bool> aborted{false};
+
+    run_snapshot_workers(std::min(options.threads, chunk_count), [&]()
+    {
+        std::vector<char> buffer;
+        aligned_buffer direct_buffer;
+        for(;;)
+        {
+            std::size_t const chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= chunk_count || aborted.load(std::memory_order_relaxed))
+                break;
+
+            buffer.clear();
+            std::uint64_t entry_count = 0;
+            if (!serialize(chunk, buffer, entry_count))
+            {
+                aborted.store(true, std::memory_order_relaxed);
+                break;
+            }
+
+            std::uint64_t const size = buffer.size();
+            std::uint64_t const padded_size = align_snapshot_offset(size);
+            std::uint64_t const offset = next_offset.fetch_add(padded_size, std::memory_order_relaxed);
+            directory[chunk] = snapshot_chunk{offset, size, entry_count, crc32c(buffer.data(), buffer.size()), 0};
+            if (padded_size == 0)
+                continue;
+
+            if (options.direct_io)
+            {
+                direct_buffer.resize(padded_size);
+                std::memcpy(direct_buffer.data(), buffer.data(), size);
+                file.write_at(direct_buffer.data(), padded_size, offset);
+            }
+            else
+            {
+                buffer.resize(padded_size);
+                file.write_at(buffer.data(), padded_size, offset);
+            }
+        }
+    });
+
+    if (aborted.load(std::memory_order_relaxed))
+        return false;
+
+    info.entry_count = 0;
+    info.log_lsn = log_lsn;
+    for (const auto& chunk : directory)
+    {
+        info.entry_count += chunk.entry_count;
+    }
+
+    snapshot_header header = make_snapshot_header(info);
+    header.chunk_count = chunk_count;
+    header.directory_crc = crc32c(directory.data(), directory_size);
+
+    aligned_buffer head;
+    head.resize(data_offset);
+    std::memcpy(head.data(), &header, sizeof(header));
+    std::memcpy(head.data() + sizeof(header), directory.data(), directory_size);
+    file.write_at(head.data(), data_offset, 0);
+    file.truncate(next_offset.load());
+    file.sync();
+    return true;
+}
+
+// Workers pread whole chunks, verify their checksum and hand them to on_chunk(data, size, entry_count)
+template<typename ChunkFunc>
+void read_chunked_snapshot(snapshot_file const& file, snapshot_header const& header, snapshot_options const& options,
+                           ChunkFunc on_chunk)
+{
+    // The writer pads the header and directory to a block boundary, reading them whole keeps O_DIRECT working
+    std::size_t const directory_size = header.chunk_count * sizeof(snapshot_chunk);
+    std::uint64_t const data_offset = align_snapshot_offset(sizeof(snapshot_header) + directory_size);
+    aligned_buffer head;
+    head.resize(data_offset);
+    file.read_at(head.data(), data_offset, 0);
+    std::vector<snapshot_chunk> directory(header.chunk_count);
+    std::memcpy(directory.data(), head.data() + sizeof(snapshot_header), directory_size);
+    if (crc32c(directory.data(), directory_size) != header.directory_crc)
+        throw std::runtime_error("snapshot chunk directory is corrupted");
+
+    std::atomic<std::size_t> next_chunk{0};
+    run_snapshot_workers(std::min<std::size_t>(options.threads, directory.size()), [&]()
+    {
+        aligned_buffer buffer;
+        for(;;)
+        {
+            std::size_t const chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= directory.size())
+                break;
+
+            snapshot_chunk const& entry = directory[chunk];
+            std::uint64_t const padded_size = align_snapshot_offset(entry.size);
+            buffer.resize(padded_size);
+            file.read_at(buffer.data(), padded_size, entry.offset);
+            if (crc32c(buffer.data(), entry.size) != entry.crc)
+                throw std::runtime_error("snapshot chunk " + std::to_string(chunk) + " is corrupted");
+
+            on_chunk(static_cast<char const*>(buffer.data()), std::size_t(entry.size), entry.entry_count);
+        }
+    });
+}
+
+constexpr char DELTA_MAGIC[8] = {'O', 'M', 'G', 'D', 'E', 'L', 'T', '\0'};
+constexpr std::uint32_t DELTA_VERSION = 1;
+
+// A delta replaces whole stripes of the table geometry it was taken with: every key of a listed
+// stripe which is missing from the delta has been removed. Stripe records follow the header
+struct delta_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t log_lsn;
+    std::uint64_t buckets_count;
+    std::uint64_t budget;
+    std::uint64_t stripe_count;
+};
+
+struct delta_stripe
+{
+    std::uint64_t stripe;
+    std::uint64_t entry_count;
+    std::uint64_t size;
+    std::uint32_t crc;
+    std::uint32_t reserved;
+};
+
+inline delta_header read_delta_header(mapped_file const& file)
+{
+    delta_header header{};
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("delta snapshot is truncated");
+
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0)
+        throw std::runtime_error("not a delta snapshot file");
+    if (header.version != DELTA_VERSION)
+        throw std::runtime_error("unsupported delta snapshot version " + std::to_string(header.version));
+    if (header.buckets_count == 0 || header.budget == 0)
+        throw std::runtime_error("delta snapshot is corrupted");
+
+    return header;
+}
+
+// Waits for a snapshot_via_fork child, returns true if the snapshot was written successfully
+inline bool wait_for_snapshot(pid_t pid)
+{
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            throw std::system_error(errno, std::generic_category(), "waitpid failed");
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Bounded queue handing batches from a single parser to insertion threads
+template<typename Item>
+class batch_queue
+{
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<std::vector<Item>> m_batches;
+    std::size_t m_capacity;
+    bool m_closed = false;
+
+public:
+    explicit batch_queue(std::size_t capacity)
+        : m_capacity{capacity}
+    {}
+
+    void push(std::vector<Item>&& batch)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_not_full.wait(lock, [this] { return m_batches.size() < m_capacity; });
+        m_batches.push_back(std::move(batch));
+        m_not_empty.notify_one();
+    }
+
+    bool pop(std::vector<Item>& batch)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_not_empty.wait(lock, [this] { return !m_batches.empty() || m_closed; });
+        if (m_batches.empty())
+            return false;
+
+        batch = std::move(m_batches.front());
+        m_batches.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+};
+}
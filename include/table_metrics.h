@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "lock_stats.h"
+#include "per_thread.h"
+#include "table_telemetry.h"
+
+namespace omega
+{
+// Counters readable without taking any stripe mutex. Operation counts and entries stay 0
+// unless enable_metrics() was called
+struct table_metrics
+{
+    std::uint64_t get_values = 0;
+    std::uint64_t get_value_hits = 0;
+    std::uint64_t add_or_updates = 0;
+    std::uint64_t inserts = 0;
+    std::uint64_t removes = 0;
+    std::uint64_t removed = 0;
+    // Entries added minus entries removed since enable_metrics()
+    std::int64_t entries = 0;
+    std::size_t buckets = 0;
+    std::size_t locks = 0;
+    std::uint64_t resizes = 0;
+    std::uint64_t resize_entries_moved = 0;
+    resize_phases resize_total;
+    // Sum over all stripes including those of tables replaced by resizes, zero unless compiled with OMEGA_LOCK_STATS
+    stripe_stats contention;
+};
+
+// Per-thread operation counters. Every slot is written only by its thread and sits on its own
+// cache line, so counting is a relaxed load and store without any shared write
+class operation_counters
+{
+    struct alignas(64) thread_counters
+    {
+        std::atomic<std::uint64_t> get_values{0};
+        std::atomic<std::uint64_t> get_value_hits{0};
+        std::atomic<std::uint64_t> add_or_updates{0};
+        std::atomic<std::uint64_t> inserts{0};
+        std::atomic<std::uint64_t> removes{0};
+        std::atomic<std::uint64_t> removed{0};
+    };
+
+    per_thread<thread_counters> m_counters;
+
+    static void increment(std::atomic<std::uint64_t>& counter, std::uint64_t value = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+public:
+    void record_get_value(bool hit)
+    {
+        thread_counters& counters = m_counters.local();
+        increment(counters.get_values);
+        if (hit)
+            increment(counters.get_value_hits);
+    }
+
+    void record_add_or_update(std::uint64_t count, std::uint64_t inserted)
+    {
+        thread_counters& counters = m_counters.local();
+        increment(counters.add_or_updates, count);
+        increment(counters.inserts, inserted);
+    }
+
+    void record_remove(bool removed)
+    {
+        thread_counters& counters = m_counters.local();
+        increment(counters.removes);
+        if (removed)
+            increment(counters.removed);
+    }
+
+    // Sums the slots of all threads. The slot list mutex is only taken by threads touching the
+    // counters for the first time
+    void load(table_metrics& metrics)
+    {
+        m_counters.for_each([&metrics](thread_counters const& counters)
+        {
+            metrics.get_values += counters.get_values.load(std::memory_order_relaxed);
+            metrics.get_value_hits += counters.get_value_hits.load(std::memory_order_relaxed);
+            metrics.add_or_updates += counters.add_or_updates.load(std::memory_order_relaxed);
+            metrics.inserts += counters.inserts.load(std::memory_order_relaxed);
+            metrics.removes += counters.removes.load(std::memory_order_relaxed);
+            metrics.removed += counters.removed.load(std::memory_order_relaxed);
+        });
+        metrics.entries = std::int64_t(metrics.inserts) - std::int64_t(metrics.removed);
+    }
+};
+
+// Prometheus text exposition format, every metric name starts with prefix
+inline std::string format_prometheus(table_metrics const& metrics, std::string const& prefix = "omega_lookup_table")
+{
+    std::string text;
+    auto const add = [&text, &prefix](char const* name, char const* type, char const* help, double value)
+    {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%.17g", value);
+        text += "# HELP " + prefix + "_" + name + " " + help + "\n";
+        text += "# TYPE " + prefix + "_" + name + " " + type + "\n";
+        text += prefix + "_" + name + " " + line + "\n";
+    };
+
+    add("get_value_total", "counter", "get_value calls", double(metrics.get_values));
+    add("get_value_hits_total", "counter", "get_value calls which found the key", double(metrics.get_value_hits));
+    add("add_or_update_total", "counter", "add_or_update calls and batch entries", double(metrics.add_or_updates));
+    add("inserts_total", "counter", "add_or_update calls which added a new key", double(metrics.inserts));
+    add("remove_total", "counter", "remove calls", double(metrics.removes));
+    add("removed_total", "counter", "remove calls which found the key", double(metrics.removed));
+    add("entries", "gauge", "entries added minus entries removed since metrics were enabled", double(metrics.entries));
+    add("buckets", "gauge", "buckets of the current table", double(metrics.buckets));
+    add("locks", "gauge", "stripe mutexes of the current table", double(metrics.locks));
+    add("resizes_total", "counter", "resizes including reserve", double(metrics.resizes));
+    add("resize_entries_moved_total", "counter", "entries rehashed by resizes", double(metrics.resize_entries_moved));
+    add("resize_lock_seconds_total", "counter", "time resizes waited for every stripe mutex", metrics.resize_total.lock_ns * 1e-9);
+    add("resize_rehash_seconds_total", "counter", "time resizes spent rehashing", metrics.resize_total.rehash_ns * 1e-9);
+    add("resize_publish_seconds_total", "counter", "time resizes spent publishing the new table", metrics.resize_total.publish_ns * 1e-9);
+    add("lock_acquires_total", "counter", "stripe mutex acquires", double(metrics.contention.acquires));
+    add("lock_contended_total", "counter", "stripe mutex acquires which had to wait", double(metrics.contention.contended_acquires));
+    add("lock_wait_seconds_total", "counter", "time spent waiting for stripe mutexes", metrics.contention.wait_ns * 1e-9);
+    add("lock_hold_seconds_total", "counter", "time stripe mutexes were held", metrics.contention.hold_ns * 1e-9);
+    return text;
+}
+}
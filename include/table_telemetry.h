@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace omega
+{
+struct resize_phases
+{
+    // Waiting for every stripe mutex in multiple_lock
+    std::uint64_t lock_ns = 0;
+    // Building the new bucket array and moving the entries into it
+    std::uint64_t rehash_ns = 0;
+    // Publishing the new table to readers and writers
+    std::uint64_t publish_ns = 0;
+};
+
+struct table_telemetry
+{
+    // Resizes, including reserve() calls which had to grow the table
+    std::uint64_t resizes = 0;
+    std::uint64_t entries_moved = 0;
+    resize_phases total;
+    resize_phases last;
+    std::size_t buckets = 0;
+    std::size_t locks = 0;
+    std::size_t entries = 0;
+    double load_factor = 0.0;
+    // chain_lengths[n] is the number of buckets holding n entries
+    std::vector<std::size_t> chain_lengths;
+};
+
+// Cumulative resize counters of a table, kept outside the bucket array so that they survive resizes
+class resize_counters
+{
+    std::atomic<std::uint64_t> m_resizes{0};
+    std::atomic<std::uint64_t> m_entries_moved{0};
+    std::atomic<std::uint64_t> m_total[3] = {};
+    std::atomic<std::uint64_t> m_last[3] = {};
+
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    // Timestamps taken before locking, once every mutex is held, after the rehash and after publishing
+    void record(clock_type::time_point start, clock_type::time_point locked, clock_type::time_point rehashed,
+                clock_type::time_point published, std::size_t entries_moved)
+    {
+        clock_type::time_point const points[4] = {start, locked, rehashed, published};
+        for (int phase = 0; phase < 3; ++phase)
+        {
+            auto const duration = std::uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(points[phase + 1] - points[phase]).count());
+            m_total[phase].fetch_add(duration, std::memory_order_relaxed);
+            m_last[phase].store(duration, std::memory_order_relaxed);
+        }
+        m_entries_moved.fetch_add(entries_moved, std::memory_order_relaxed);
+        m_resizes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void load(table_telemetry& telemetry) const
+    {
+        telemetry.resizes = m_resizes.load(std::memory_order_relaxed);
+        telemetry.entries_moved = m_entries_moved.load(std::memory_order_relaxed);
+        telemetry.total = resize_phases{m_total[0].load(std::memory_order_relaxed), m_total[1].load(std::memory_order_relaxed),
+                                        m_total[2].load(std::memory_order_relaxed)};
+        telemetry.last = resize_phases{m_last[0].load(std::memory_order_relaxed), m_last[1].load(std::memory_order_relaxed),
+                                       m_last[2].load(std::memory_order_relaxed)};
+    }
+};
+}
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "concurrent_lookup_table.h"
+#include "snapshot.h"
+
+namespace omega
+{
+// Append-only file of serialized values, split into fixed size segments which are mapped once
+// they are created. Readers go through the mappings without taking any lock. The mappings outlive
+// the path, a log replaced by rename() stays readable until it is destroyed
+class value_log
+{
+    constexpr static std::size_t MAX_SEGMENTS = 4096;
+
+    snapshot_file m_file;
+    std::size_t m_segment_size;
+    std::array<std::atomic<char*>, MAX_SEGMENTS> m_segments{};
+    mutable std::mutex m_append_mutex;
+    // Guarded by m_append_mutex
+    std::uint64_t m_end = 0;
+    std::size_t m_records = 0;
+
+    char* map_segment(std::size_t segment)
+    {
+        m_file.truncate((segment + 1) * std::uint64_t(m_segment_size));
+        void* data = ::mmap(nullptr, m_segment_size, PROT_READ, MAP_SHARED, m_file.get(), off_t(segment * m_segment_size));
+        if (data == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "cannot map value log segment");
+
+        ::madvise(data, m_segment_size, MADV_RANDOM);
+        char* const segment_data = static_cast<char*>(data);
+        m_segments[segment].store(segment_data, std::memory_order_release);
+        return segment_data;
+    }
+
+public:
+    explicit value_log(std::string const& path, std::size_t segment_size = 64 << 20)
+        : m_file{path, O_RDWR | O_CREAT | O_TRUNC}
+        , m_segment_size{segment_size}
+    {}
+
+    ~value_log()
+    {
+        for (auto& segment : m_segments)
+        {
+            if (char* data = segment.load(std::memory_order_relaxed))
+                ::munmap(data, m_segment_size);
+        }
+    }
+
+    value_log(value_log const& other)=delete;
+    value_log& operator=(value_log const& other)=delete;
+
+    // Record layout: u32 size, bytes. Records never cross a segment boundary
+    std::uint64_t append(char const* data, std::size_t data_size)
+    {
+        std::size_t const size = sizeof(std::uint32_t) + data_size;
+        if (size > m_segment_size)
+            throw std::length_error("value does not fit into a value log segment");
+
+        std::lock_guard<std::mutex> lock{m_append_mutex};
+        std::size_t segment = m_end / m_segment_size;
+        if (m_end % m_segment_size + size > m_segment_size)
+        {
+            ++segment;
+            m_end = segment * std::uint64_t(m_segment_size);
+        }
+        if (segment >= MAX_SEGMENTS)
+            throw std::length_error("value log is full");
+        if (!m_segments[segment].load(std::memory_order_relaxed))
+            map_segment(segment);
+
+        std::uint64_t const offset = m_end;
+        std::uint32_t const record_size = std::uint32_t(data_size);
+        m_file.write_at(&record_size, sizeof(record_size), offset);
+        m_file.write_at(data, data_size, offset + sizeof(record_size));
+        m_end += size;
+        ++m_records;
+        return offset;
+    }
+
+    std::uint64_t append(std::vector<char> const& record)
+    {
+        return append(record.data(), record.size());
+    }
+
+    std::pair<char const*, std::size_t> read(std::uint64_t offset) const
+    {
+        char const* const segment = m_segments[offset / m_segment_size].load(std::memory_order_acquire);
+        char const* const record = segment + offset % m_segment_size;
+        std::uint32_t size = 0;
+        std::memcpy(&size, record, sizeof(size));
+        return {record + sizeof(size), size};
+    }
+
+    std::uint64_t size() const
+    {
+        std::lock_guard<std::mutex> lock{m_append_mutex};
+        return m_end;
+    }
+
+    // Number of records appended, including the ones nothing refers to anymore
+    std::size_t records() const
+    {
+        std::lock_guard<std::mutex> lock{m_append_mutex};
+        return m_records;
+    }
+
+    std::size_t segment_size() const
+    {
+        return m_segment_size;
+    }
+};
+
+// Per-key state kept in the table. The hot value lives behind a pointer, so a spilled entry shrinks to
+// the null pointer and one word for its value log record whatever the size of Value
+template<typename Value>
+class tiered_slot
+{
+    constexpr static std::uint64_t REFERENCED = 1;
+    constexpr static std::uint64_t GENERATION = 2;
+    constexpr static std::uint64_t NO_RECORD = ~std::uint64_t(0) << 2;
+
+    // Shared, so readers and the sweep copy the pointer under the stripe mutex instead of the value
+    std::shared_ptr<Value const> m_value;
+    // Offset of the value log record << 2 | log generation << 1 | CLOCK reference bit
+    std::uint64_t m_state = NO_RECORD | REFERENCED;
+
+public:
+    tiered_slot()=default;
+
+    explicit tiered_slot(Value const& value)
+        : m_value{std::make_shared<Value const>(value)}
+    {}
+
+    // Null once the value was spilled
+    std::shared_ptr<Value const> const& value() const
+    {
+        return m_value;
+    }
+
+    void set_value(std::shared_ptr<Value const> value)
+    {
+        m_value = std::move(value);
+    }
+
+    // Drops the hot copy, the value stays readable from the record
+    void spill(std::uint64_t offset, unsigned generation)
+    {
+        m_value.reset();
+        set_record(offset, generation);
+    }
+
+    void set_record(std::uint64_t offset, unsigned generation)
+    {
+        m_state = offset << 2 | (generation ? GENERATION : 0) | (m_state & REFERENCED);
+    }
+
+    bool has_record() const
+    {
+        return (m_state & NO_RECORD) != NO_RECORD;
+    }
+
+    std::uint64_t record() const
+    {
+        return m_state >> 2;
+    }
+
+    unsigned generation() const
+    {
+        return (m_state & GENERATION) != 0 ? 1 : 0;
+    }
+
+    bool referenced() const
+    {
+        return (m_state & REFERENCED) != 0;
+    }
+
+    void set_referenced(bool referenced)
+    {
+        m_state = (m_state & ~REFERENCED) | (referenced ? REFERENCED : 0);
+    }
+};
+
+// Keeps the hot set in memory and spills cold values to an mmap'd value log, the keys and a small
+// slot stay in the table so every key remains reachable. evict() runs a CLOCK sweep: a hot entry
+// read or written since the previous sweep gets a second chance, otherwise its value is spilled.
+// A get_value on a spilled key reads it from the log and faults it back in. Residency changes leave
+// the stripes' dirty flags alone, a delta snapshot only follows add_or_update and remove.
+// Updates and removes leave stale records behind, compact() copies the live ones into a fresh log
+// and evict() does so by itself once the stale records outnumber the live ones
+template<typename Key, typename Value, std::size_t MaxLoadFactor = 4, typename Hash = std::hash<Key>, typename Tracer = null_tracer,
+         typename Mutex = std::mutex>
+class tiered_lookup_table
+{
+    using slot_type = tiered_slot<Value>;
+    using value_pointer = std::shared_ptr<Value const>;
+
+    mutable concurrent_lookup_table<Key, slot_type, MaxLoadFactor, Hash, Tracer, Mutex> m_table;
+    std::string m_path;
+    // Indexed by slot generation. A compaction fills the other entry, moves the records over and
+    // drops the old log, readers pick the log under the stripe mutex and read after releasing it
+    std::shared_ptr<value_log> m_logs[2];
+    std::atomic<unsigned> m_generation{0};
+    // Serializes appends and compactions, the sweep also relies on nothing else clearing referenced
+    // flags between collecting and spilling
+    std::mutex m_evict_mutex;
+
+    std::shared_ptr<value_log> log(unsigned generation) const
+    {
+        return std::atomic_load(&m_logs[generation]);
+    }
+
+    static Value read_cold(value_log const& log, std::uint64_t offset)
+    {
+        auto const record = log.read(offset);
+        char const* cursor = record.first;
+        Value value;
+        if (!snapshot_serializer<Value>::read(cursor, record.first + record.second, value))
+            throw std::runtime_error("value log record is malformed");
+        return value;
+    }
+
+    std::uint64_t compact_locked()
+    {
+        unsigned const from = m_generation;
+        unsigned const to = from ^ 1;
+        std::vector<std::pair<Key, std::uint64_t>> records;
+        m_table.for_each_untracked([&records](Key const& key, slot_type const& slot)
+        {
+            if (slot.has_record())
+                records.emplace_back(key, slot.record());
+        });
+
+        std::string const compact_path = m_path + ".compact";
+        std::shared_ptr<value_log> const source = log(from);
+        auto const target = std::make_shared<value_log>(compact_path, source->segment_size());
+        std::atomic_store(&m_logs[to], target);
+        for (auto const& record : records)
+        {
+            auto const data = source->read(record.second);
+            std::uint64_t const offset = target->append(data.first, data.second);
+            // Skips keys updated or removed since they were collected
+            m_table.visit_untracked(record.first, [&record, offset, from, to](slot_type& slot)
+            {
+                if (slot.has_record() && slot.record() == record.second && slot.generation() == from)
+                    slot.set_record(offset, to);
+            });
+        }
+
+        m_generation = to;
+        if (std::rename(compact_path.c_str(), m_path.c_str()) != 0)
+            throw std::system_error(errno, std::generic_category(), "cannot replace value log " + m_path);
+        // Readers which picked the old log before their key moved keep it alive until they are done
+        std::atomic_store(&m_logs[from], std::shared_ptr<value_log>{});
+        return source->size() > target->size() ? source->size() - target->size() : 0;
+    }
+
+public:
+    tiered_lookup_table(std::string const& value_log_path, std::size_t concurrency, std::size_t capacity,
+                        bool grow_concurrency_on_resize = true)
+        : m_table{concurrency, capacity, grow_concurrency_on_resize}
+        , m_path{value_log_path}
+        , m_logs{std::make_shared<value_log>(value_log_path), nullptr}
+    {}
+
+    std::optional<Value> get_value(Key const& key) const
+    {
+        value_pointer hot;
+        std::shared_ptr<value_log> cold;
+        std::uint64_t offset = 0;
+        unsigned generation = 0;
+        bool const found = m_table.visit_untracked(key, [this, &hot, &cold, &offset, &generation](slot_type& slot)
+        {
+            slot.set_referenced(true);
+            hot = slot.value();
+            if (hot)
+                return;
+            offset = slot.record();
+            generation = slot.generation();
+            cold = log(generation);
+        });
+        if (!found)
+            return std::optional<Value>{};
+        if (hot)
+            return *hot;
+
+        auto const value = std::make_shared<Value const>(read_cold(*cold, offset));
+        m_table.visit_untracked(key, [&value, offset, generation](slot_type& slot)
+        {
+            if (!slot.value() && slot.has_record() && slot.record() == offset && slot.generation() == generation)
+                slot.set_value(value);
+        });
+        return *value;
+    }
+
+    void add_or_update(Key const& key, Value const& value)
+    {
+        m_table.add_or_update(key, slot_type{value});
+    }
+
+    void remove(Key const& key)
+    {
+        m_table.remove(key);
+    }
+
+    // Spills values until at most max_hot_entries stay in memory, returns the number of spilled values.
+    // Victims are picked under the stripe mutexes and written to the value log after releasing them
+    std::size_t evict(std::size_t max_hot_entries)
+    {
+        std::lock_guard<std::mutex> evict_lock{m_evict_mutex};
+        std::size_t hot = 0;
+        std::size_t live = 0;
+        m_table.for_each_untracked([&hot, &live](Key const&, slot_type const& slot)
+        {
+            if (slot.value())
+                ++hot;
+            if (slot.has_record())
+                ++live;
+        });
+
+        std::shared_ptr<value_log> target = log(m_generation);
+        if (target->size() >= target->segment_size() && target->records() - live > live)
+        {
+            compact_locked();
+            target = log(m_generation);
+        }
+        unsigned const generation = m_generation;
+
+        std::size_t spilled = 0;
+        std::vector<char> record;
+        std::vector<std::pair<Key, value_pointer>> victims;
+        for (int sweep = 0; sweep < 2 && hot > max_hot_entries; ++sweep)
+        {
+            m_table.for_each_untracked([&hot, &spilled, &victims, max_hot_entries](Key const& key, slot_type& slot)
+            {
+                if (!slot.value() || hot <= max_hot_entries)
+                    return;
+
+                if (slot.referenced())
+                {
+                    slot.set_referenced(false);
+                    return;
+                }
+
+                // A value faulted back in and not updated since is still in the log
+                if (slot.has_record())
+                {
+                    slot.set_value(nullptr);
+                    ++spilled;
+                    Tracer::evicted();
+                }
+                else
+                {
+                    victims.emplace_back(key, slot.value());
+                }
+                --hot;
+            });
+
+            for (auto const& victim : victims)
+            {
+                record.clear();
+                snapshot_serializer<Value>::write(record, *victim.second);
+                std::uint64_t const offset = target->append(record);
+                // An update since replaced the value and a read set referenced, the record is stale then
+                m_table.visit_untracked(victim.first, [&spilled, &victim, offset, generation](slot_type& slot)
+                {
+                    if (slot.value() != victim.second || slot.referenced())
+                        return;
+                    slot.spill(offset, generation);
+                    ++spilled;
+                    Tracer::evicted();
+                });
+            }
+            victims.clear();
+        }
+
+        return spilled;
+    }
+
+    // Copies the records still referenced by a key into a new value log and moves the keys over one
+    // stripe visit at a time, returns the number of bytes reclaimed. Reads keep going meanwhile
+    std::uint64_t compact()
+    {
+        std::lock_guard<std::mutex> evict_lock{m_evict_mutex};
+        return compact_locked();
+    }
+
+    std::uint64_t value_log_size() const
+    {
+        return log(m_generation)->size();
+    }
+
+};
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace omega
+{
+// Default Tracer policy of concurrent_lookup_table and tiered_lookup_table. Every hook is an empty
+// static function, so calls and the arguments computed only for them are optimized away. A custom
+// tracer(e.g. firing USDT/LTTng probes or bumping counters) derives from null_tracer and hides the
+// hooks it needs
+struct null_tracer
+{
+    // A stripe mutex was taken for a single key or stripe, lock_released runs right before it is unlocked
+    static void lock_acquired(std::size_t /*stripe*/) {}
+    static void lock_released(std::size_t /*stripe*/) {}
+
+    // Number of entries compared by a bucket lookup, including the match
+    static void probed(std::size_t /*length*/) {}
+
+    // Every stripe mutex is held between resize_started and resize_finished
+    static void resize_started(std::size_t /*buckets*/) {}
+    static void resize_finished(std::size_t /*buckets*/, std::size_t /*entries_moved*/) {}
+
+    // A resize replaced the table while an operation waited for a mutex, the operation starts over
+    static void table_replaced() {}
+
+    // tiered_lookup_table spilled a value to its value log
+    static void evicted() {}
+};
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "per_thread.h"
+#include "snapshot.h"
+
+namespace omega
+{
+enum class trace_operation : std::uint8_t
+{
+    get_value = 1,
+    add_or_update = 2,
+    remove = 3
+};
+
+struct trace_record
+{
+    // Nanoseconds since the recorder was created
+    std::uint64_t timestamp_ns;
+    // The key itself for trivially copyable keys up to 8 bytes, its hash otherwise
+    std::uint64_t key;
+    std::uint32_t value_size;
+    // Threads are numbered in the order they first touched the table
+    std::uint16_t thread;
+    trace_operation operation;
+    std::uint8_t reserved;
+};
+static_assert(sizeof(trace_record) == 24, "trace records are written as raw bytes");
+
+constexpr char TRACE_MAGIC[8] = {'O', 'M', 'G', 'T', 'R', 'A', 'C', 'E'};
+constexpr std::uint32_t TRACE_VERSION = 1;
+constexpr std::uint32_t TRACE_EXACT_KEYS = 1;
+
+struct trace_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t record_count;
+    // Records overwritten in full ring buffers before save()
+    std::uint64_t dropped;
+};
+
+struct workload_trace
+{
+    trace_header header;
+    std::vector<trace_record> records;
+};
+
+struct trace_options
+{
+    // Records kept per thread, the oldest ones are overwritten once a ring is full
+    std::size_t ring_capacity = 1 << 20;
+};
+
+template<typename Value>
+struct trace_value_size
+{
+    static std::uint32_t get(Value const&)
+    {
+        return std::is_trivially_copyable_v<Value> ? std::uint32_t(sizeof(Value)) : 0;
+    }
+};
+
+template<>
+struct trace_value_size<std::string>
+{
+    static std::uint32_t get(std::string const& value)
+    {
+        return std::uint32_t(value.size());
+    }
+};
+
+// Records operations into per-thread rings under an uncontended mutex, save() merges the rings
+// in timestamp order. Attach it with concurrent_lookup_table::attach_trace
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class trace_recorder
+{
+    constexpr static bool EXACT_KEYS = std::is_trivially_copyable_v<Key> && sizeof(Key) <= sizeof(std::uint64_t);
+    constexpr static std::uint32_t NO_THREAD = ~std::uint32_t(0);
+
+    struct thread_ring
+    {
+        std::mutex mutex;
+        std::uint32_t thread = NO_THREAD;
+        std::vector<trace_record> records;
+        // Next slot to write once the ring is full
+        std::size_t next = 0;
+        std::uint64_t dropped = 0;
+    };
+
+    trace_options m_options;
+    std::chrono::steady_clock::time_point const m_start;
+    std::atomic<std::uint32_t> m_next_thread{0};
+    per_thread<thread_ring> m_rings;
+    Hash hasher;
+
+    std::uint64_t encode(Key const& key) const
+    {
+        if constexpr (EXACT_KEYS)
+        {
+            std::uint64_t encoded = 0;
+            std::memcpy(&encoded, &key, sizeof(Key));
+            return encoded;
+        }
+        else
+        {
+            return std::uint64_t(hasher(key));
+        }
+    }
+
+public:
+    explicit trace_recorder(trace_options options = {})
+        : m_options{options}
+        , m_start{std::chrono::steady_clock::now()}
+    {
+        m_options.ring_capacity = std::max<std::size_t>(m_options.ring_capacity, 1);
+    }
+
+    void record(trace_operation operation, Key const& key, std::uint32_t value_size)
+    {
+        auto const timestamp = std::uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+        thread_ring& ring = m_rings.local();
+        std::lock_guard<std::mutex> lock{ring.mutex};
+        if (ring.thread == NO_THREAD)
+            ring.thread = m_next_thread.fetch_add(1, std::memory_order_relaxed);
+
+        trace_record const record{timestamp, encode(key), value_size, std::uint16_t(ring.thread), operation, 0};
+        if (ring.records.size() < m_options.ring_capacity)
+        {
+            ring.records.push_back(record);
+            return;
+        }
+
+        ring.records[ring.next] = record;
+        ring.next = (ring.next + 1) % ring.records.size();
+        ++ring.dropped;
+    }
+
+    void record_update(Key const& key, Value const& value)
+    {
+        record(trace_operation::add_or_update, key, trace_value_size<Value>::get(value));
+    }
+
+    // Writes the records of every thread ordered by timestamp, a thread keeps its own order on ties.
+    // Returns the number of written records
+    std::uint64_t save(std::string const& path)
+    {
+        std::vector<trace_record> records;
+        std::uint64_t dropped = 0;
+        m_rings.for_each([&records, &dropped](thread_ring& ring)
+        {
+            std::lock_guard<std::mutex> lock{ring.mutex};
+            records.insert(records.end(), ring.records.begin() + ring.next, ring.records.end());
+            records.insert(records.end(), ring.records.begin(), ring.records.begin() + ring.next);
+            dropped += ring.dropped;
+        });
+        std::stable_sort(records.begin(), records.end(),
+                         [](trace_record const& lhs, trace_record const& rhs) { return lhs.timestamp_ns < rhs.timestamp_ns; });
+
+        trace_header header{};
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.flags = EXACT_KEYS ? TRACE_EXACT_KEYS : 0;
+        header.record_count = records.size();
+        header.dropped = dropped;
+
+        snapshot_file file{path, O_WRONLY | O_CREAT | O_TRUNC};
+        file.write_at(&header, sizeof(header), 0);
+        file.write_at(records.data(), records.size() * sizeof(trace_record), sizeof(header));
+        return records.size();
+    }
+};
+
+inline workload_trace read_trace(std::string const& path)
+{
+    mapped_file file{path};
+    workload_trace trace{};
+    if (file.size() < sizeof(trace_header))
+        throw std::runtime_error(path + " is not a trace");
+
+    std::memcpy(&trace.header, file.data(), sizeof(trace_header));
+    if (std::memcmp(trace.header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || trace.header.version != TRACE_VERSION)
+        throw std::runtime_error(path + " is not a trace");
+    if ((file.size() - sizeof(trace_header)) / sizeof(trace_record) < trace.header.record_count)
+        throw std::runtime_error("trace is truncated");
+
+    trace.records.resize(trace.header.record_count);
+    if (!trace.records.empty())
+        std::memcpy(trace.records.data(), file.data() + sizeof(trace_header), trace.records.size() * sizeof(trace_record));
+    return trace;
+}
+}
@@ -0,0 +1,156 @@
+#include "allocation_counter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+namespace
+{
+// Constant initialized, so counting works from the first allocation of a thread on
+thread_local omega::allocation_stats counters;
+
+void* allocate(std::size_t size)
+{
+    void* pointer = std::malloc(size ? size : 1);
+    if (pointer)
+    {
+        ++counters.allocations;
+        counters.bytes_allocated += malloc_usable_size(pointer);
+    }
+    return pointer;
+}
+
+void* allocate(std::size_t size, std::align_val_t alignment)
+{
+    std::size_t const align = std::max(std::size_t(alignment), sizeof(void*));
+    void* pointer = nullptr;
+    if (::posix_memalign(&pointer, align, size ? size : 1) != 0)
+        return nullptr;
+    ++counters.allocations;
+    counters.bytes_allocated += malloc_usable_size(pointer);
+    return pointer;
+}
+
+void deallocate(void* pointer) noexcept
+{
+    if (!pointer)
+        return;
+    ++counters.deallocations;
+    counters.bytes_deallocated += malloc_usable_size(pointer);
+    std::free(pointer);
+}
+}
+
+namespace omega
+{
+allocation_stats thread_allocations()
+{
+    return counters;
+}
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* pointer = allocate(size))
+        return pointer;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void* pointer = allocate(size, alignment))
+        return pointer;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    return allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    return allocate(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::nothrow_t const&) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::nothrow_t const&) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, std::nothrow_t const&) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, std::nothrow_t const&) noexcept
+{
+    deallocate(pointer);
+}
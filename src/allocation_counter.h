@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+namespace omega
+{
+struct allocation_stats
+{
+    std::uint64_t allocations = 0;
+    std::uint64_t deallocations = 0;
+    // Usable sizes as reported by the allocator, which may round requests up
+    std::uint64_t bytes_allocated = 0;
+    std::uint64_t bytes_deallocated = 0;
+
+    std::int64_t live_bytes() const
+    {
+        return std::int64_t(bytes_allocated) - std::int64_t(bytes_deallocated);
+    }
+};
+
+// Operator new/delete calls of the calling thread. Counted by the global replacements in
+// allocation_counter.cpp, so only programs linking it get non-zero values. Memory freed by another
+// thread is counted there
+allocation_stats thread_allocations();
+
+// Allocations of the calling thread since construction
+class allocation_scope
+{
+    allocation_stats m_start;
+
+public:
+    allocation_scope()
+        : m_start{thread_allocations()}
+    {
+    }
+
+    allocation_stats counted() const
+    {
+        allocation_stats const now = thread_allocations();
+        return allocation_stats{now.allocations - m_start.allocations, now.deallocations - m_start.deallocations,
+                                now.bytes_allocated - m_start.bytes_allocated,
+                                now.bytes_deallocated - m_start.bytes_deallocated};
+    }
+};
+}
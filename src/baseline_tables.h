@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace omega
+{
+// Trivial designs the striped table is measured against. They share the constructor and the
+// get_value/add_or_update/remove/reserve interface of concurrent_lookup_table
+
+// std::unordered_map behind a single std::mutex
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class mutex_lookup_table
+{
+    mutable std::mutex m_mutex;
+    std::unordered_map<Key, Value, Hash> m_map;
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    mutex_lookup_table(std::size_t /*concurrency*/, std::size_t capacity)
+        : m_map(capacity)
+    {}
+
+    std::optional<Value> get_value(Key const& key) const
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        auto const it = m_map.find(key);
+        return it == m_map.end() ? std::optional<Value>{} : std::optional<Value>{it->second};
+    }
+
+    void add_or_update(Key const& key, Value const& value)
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        m_map.insert_or_assign(key, value);
+    }
+
+    void remove(Key const& key)
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        m_map.erase(key);
+    }
+
+    void reserve(std::size_t count)
+    {
+        std::lock_guard<std::mutex> const lock{m_mutex};
+        m_map.reserve(count);
+    }
+};
+
+// std::unordered_map behind a single std::shared_mutex, readers share it
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class shared_mutex_lookup_table
+{
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<Key, Value, Hash> m_map;
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    shared_mutex_lookup_table(std::size_t /*concurrency*/, std::size_t capacity)
+        : m_map(capacity)
+    {}
+
+    std::optional<Value> get_value(Key const& key) const
+    {
+        std::shared_lock<std::shared_mutex> const lock{m_mutex};
+        auto const it = m_map.find(key);
+        return it == m_map.end() ? std::optional<Value>{} : std::optional<Value>{it->second};
+    }
+
+    void add_or_update(Key const& key, Value const& value)
+    {
+        std::lock_guard<std::shared_mutex> const lock{m_mutex};
+        m_map.insert_or_assign(key, value);
+    }
+
+    void remove(Key const& key)
+    {
+        std::lock_guard<std::shared_mutex> const lock{m_mutex};
+        m_map.erase(key);
+    }
+
+    void reserve(std::size_t count)
+    {
+        std::lock_guard<std::shared_mutex> const lock{m_mutex};
+        m_map.reserve(count);
+    }
+};
+
+// concurrency independent std::unordered_maps, each behind its own std::mutex. Unlike the striped
+// table every shard resizes on its own and the shard count never changes
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class sharded_lookup_table
+{
+    struct alignas(64) shard_type
+    {
+        std::mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+
+    std::unique_ptr<shard_type[]> m_shards;
+    std::size_t m_shards_count;
+    Hash hasher;
+
+    shard_type& get_shard(Key const& key) const
+    {
+        return m_shards[hasher(key) % m_shards_count];
+    }
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    sharded_lookup_table(std::size_t concurrency, std::size_t capacity)
+        : m_shards{new shard_type[std::max<std::size_t>(concurrency, 1)]}
+        , m_shards_count{std::max<std::size_t>(concurrency, 1)}
+    {
+        reserve(capacity);
+    }
+
+    std::optional<Value> get_value(Key const& key) const
+    {
+        shard_type& shard = get_shard(key);
+        std::lock_guard<std::mutex> const lock{shard.mutex};
+        auto const it = shard.map.find(key);
+        return it == shard.map.end() ? std::optional<Value>{} : std::optional<Value>{it->second};
+    }
+
+    void add_or_update(Key const& key, Value const& value)
+    {
+        shard_type& shard = get_shard(key);
+        std::lock_guard<std::mutex> const lock{shard.mutex};
+        shard.map.insert_or_assign(key, value);
+    }
+
+    void remove(Key const& key)
+    {
+        shard_type& shard = get_shard(key);
+        std::lock_guard<std::mutex> const lock{shard.mutex};
+        shard.map.erase(key);
+    }
+
+    void reserve(std::size_t count)
+    {
+        for (std::size_t i = 0; i < m_shards_count; ++i)
+        {
+            std::lock_guard<std::mutex> const lock{m_shards[i].mutex};
+            m_shards[i].map.reserve(count / m_shards_count + 1);
+        }
+    }
+};
+}
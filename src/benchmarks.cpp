@@ -0,0 +1,525 @@
+#include "allocation_counter.h"
+#include "baseline_tables.h"
+#include "concurrent_lookup_table.h"
+#include "latency_histogram.h"
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeindex>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+namespace
+{
+struct key16
+{
+    std::uint64_t high;
+    std::uint64_t low;
+
+    bool operator==(key16 const& other) const
+    {
+        return high == other.high && low == other.low;
+    }
+};
+
+struct key16_hash
+{
+    std::size_t operator()(key16 const& key) const
+    {
+        return std::hash<std::uint64_t>{}(key.high ^ (key.low * 0x9E3779B97F4A7C15ull));
+    }
+};
+
+template<typename Key>
+struct key_traits;
+
+template<>
+struct key_traits<int>
+{
+    using hash = std::hash<int>;
+    constexpr static char const* name = "int";
+    constexpr static std::size_t heap_bytes = 0;
+
+    static int make(std::uint64_t index)
+    {
+        return int(index);
+    }
+};
+
+template<>
+struct key_traits<key16>
+{
+    using hash = key16_hash;
+    constexpr static char const* name = "key16";
+    constexpr static std::size_t heap_bytes = 0;
+
+    static key16 make(std::uint64_t index)
+    {
+        return key16{index, ~index};
+    }
+};
+
+template<>
+struct key_traits<std::string>
+{
+    using hash = std::hash<std::string>;
+    constexpr static char const* name = "string64";
+    // 64 characters plus the terminator, rounded up by the allocator
+    constexpr static std::size_t heap_bytes = 80;
+
+    static std::string make(std::uint64_t index)
+    {
+        std::string key(64, 'k');
+        std::string const digits = std::to_string(index);
+        key.replace(0, digits.size(), digits);
+        return key;
+    }
+};
+
+using value_type = std::uint64_t;
+
+template<typename Key>
+using striped_table = omega::concurrent_lookup_table<Key, value_type, 4, typename key_traits<Key>::hash>;
+
+// Same table with omega::adaptive_mutex stripes instead of std::mutex
+template<typename Key>
+using adaptive_table = omega::concurrent_lookup_table<Key, value_type, 4, typename key_traits<Key>::hash, omega::null_tracer,
+                                                      omega::adaptive_mutex>;
+
+// Same table with FIFO omega::mcs_mutex stripes
+template<typename Key>
+using mcs_table = omega::concurrent_lookup_table<Key, value_type, 4, typename key_traits<Key>::hash, omega::null_tracer,
+                                                 omega::mcs_mutex>;
+
+template<typename Key>
+using mutex_table = omega::mutex_lookup_table<Key, value_type, typename key_traits<Key>::hash>;
+
+template<typename Key>
+using shared_mutex_table = omega::shared_mutex_lookup_table<Key, value_type, typename key_traits<Key>::hash>;
+
+template<typename Key>
+using sharded_table = omega::sharded_lookup_table<Key, value_type, typename key_traits<Key>::hash>;
+
+// Approximate memory taken by one entry: list node with two pointers, allocator header and a share of the bucket array
+template<typename Key>
+constexpr std::size_t entry_bytes()
+{
+    return sizeof(std::pair<Key, value_type>) + 2 * sizeof(void*) + 16 + key_traits<Key>::heap_bytes + sizeof(std::list<int>) / 2;
+}
+
+template<typename Table>
+struct dataset
+{
+    using key_type = typename Table::key_type;
+
+    std::vector<key_type> keys;
+    Table table;
+
+    explicit dataset(std::size_t entries)
+        : table{256, 256}
+    {
+        keys.reserve(entries);
+        table.reserve(entries);
+        for (std::size_t i = 0; i < entries; ++i)
+        {
+            keys.push_back(key_traits<key_type>::make(i));
+            table.add_or_update(keys.back(), i);
+        }
+    }
+};
+
+struct dataset_cache
+{
+    std::mutex mutex;
+    std::shared_ptr<void> current;
+    std::type_index type{typeid(void)};
+    std::size_t entries = 0;
+};
+
+dataset_cache& get_dataset_cache()
+{
+    static dataset_cache cache;
+    return cache;
+}
+
+// Benchmarks run in registration order, so only the dataset of the current run is kept alive
+template<typename Table>
+std::shared_ptr<dataset<Table>> get_dataset(std::size_t entries)
+{
+    dataset_cache& cache = get_dataset_cache();
+    std::lock_guard<std::mutex> const lock{cache.mutex};
+    if (cache.type != std::type_index{typeid(Table)} || cache.entries != entries)
+    {
+        cache.current.reset();
+        cache.current = std::make_shared<dataset<Table>>(entries);
+        cache.type = std::type_index{typeid(Table)};
+        cache.entries = entries;
+    }
+
+    return std::static_pointer_cast<dataset<Table>>(cache.current);
+}
+
+// Latencies of every thread of the current run. Per-thread percentiles cannot be combined, so each thread
+// merges its histogram here and all of them report the percentiles of the merged one
+struct latency_merge
+{
+    std::mutex mutex;
+    std::condition_variable all_merged;
+    omega::latency_histogram latencies;
+    int merged = 0;
+    int reported = 0;
+};
+
+latency_merge& get_latency_merge()
+{
+    static latency_merge merge;
+    return merge;
+}
+
+// Returns once every thread of the run merged its latencies, the next run starts with an empty histogram
+std::pair<std::uint64_t, std::uint64_t> merge_tail_latencies(benchmark::State const& state,
+                                                             omega::latency_histogram const& latencies)
+{
+    latency_merge& merge = get_latency_merge();
+    std::unique_lock<std::mutex> lock{merge.mutex};
+    merge.latencies.merge(latencies);
+    if (++merge.merged == state.threads())
+        merge.all_merged.notify_all();
+    merge.all_merged.wait(lock, [&merge, &state] { return merge.merged == state.threads(); });
+
+    std::pair<std::uint64_t, std::uint64_t> const tail{merge.latencies.percentile(99), merge.latencies.percentile(99.9)};
+    if (++merge.reported == state.threads())
+    {
+        merge.latencies = omega::latency_histogram{};
+        merge.merged = 0;
+        merge.reported = 0;
+    }
+    return tail;
+}
+
+// xorshift64*, cheap enough not to dominate a lookup
+class random_generator
+{
+    std::uint64_t m_state;
+
+public:
+    explicit random_generator(std::uint64_t seed)
+        : m_state{seed * 0x9E3779B97F4A7C15ull + 1}
+    {}
+
+    std::uint64_t next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 0x2545F4914F6CDD1Dull;
+    }
+};
+
+bool perf_counters_enabled = false;
+
+// Counts hardware events and heap allocations of the calling benchmark thread from construction
+// until report(), so creating it right before the timed loop leaves dataset setup out
+class perf_scope
+{
+    std::unique_ptr<omega::perf_counters> m_counters;
+    omega::allocation_scope m_allocations;
+
+public:
+    perf_scope()
+    {
+        if (!perf_counters_enabled)
+            return;
+        m_counters = std::make_unique<omega::perf_counters>();
+        m_counters->start();
+    }
+
+    // Google Benchmark sums the counters of all threads and divides them by the total iterations
+    void report(benchmark::State& state, std::size_t operations_per_iteration)
+    {
+        omega::allocation_stats const allocations = m_allocations.counted();
+        state.counters["allocs"] = benchmark::Counter(double(allocations.allocations) / operations_per_iteration,
+                                                      benchmark::Counter::kAvgIterations);
+        state.counters["alloc_bytes"] = benchmark::Counter(double(allocations.bytes_allocated) / operations_per_iteration,
+                                                           benchmark::Counter::kAvgIterations);
+        if (!m_counters)
+            return;
+
+        auto const values = m_counters->stop();
+        for (std::size_t i = 0; i < omega::perf_counters::COUNTERS; ++i)
+        {
+            if (m_counters->is_open(i))
+                state.counters[omega::perf_counters::name(i)] =
+                    benchmark::Counter(values[i] / operations_per_iteration, benchmark::Counter::kAvgIterations);
+        }
+    }
+};
+
+// read_percent of the operations are get_value, the rest add_or_update of existing keys
+template<typename Table>
+void mixed_operations(benchmark::State& state, std::size_t entries, int read_percent)
+{
+    auto const data = get_dataset<Table>(entries);
+    auto& table = data->table;
+    auto const& keys = data->keys;
+    random_generator random{std::uint64_t(state.thread_index()) + 1};
+    perf_scope counters;
+    for (auto _ : state)
+    {
+        std::uint64_t const number = random.next();
+        auto const& key = keys[number % keys.size()];
+        if (int((number >> 40) % 100) < read_percent)
+            benchmark::DoNotOptimize(table.get_value(key));
+        else
+            table.add_or_update(key, number);
+    }
+    counters.report(state, 1);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Every iteration removes a key and adds it back, the table size stays the same
+template<typename Table>
+void remove_add(benchmark::State& state, std::size_t entries)
+{
+    auto const data = get_dataset<Table>(entries);
+    auto& table = data->table;
+    auto const& keys = data->keys;
+    random_generator random{std::uint64_t(state.thread_index()) + 1};
+    perf_scope counters;
+    for (auto _ : state)
+    {
+        std::uint64_t const number = random.next();
+        auto const& key = keys[number % keys.size()];
+        table.remove(key);
+        table.add_or_update(key, number);
+    }
+    counters.report(state, 2);
+    state.SetItemsProcessed(2 * state.iterations());
+}
+
+// Every iteration updates one of a few hot keys through visit() and keeps its stripe locked for
+// hold_ns, so the lock sees short(0) and long critical sections under contention. Reports the
+// p99 and p99.9 operation latency over all threads next to the throughput
+template<typename Table>
+void hold_time(benchmark::State& state, std::size_t entries, std::size_t hold_ns)
+{
+    auto const data = get_dataset<Table>(entries);
+    auto& table = data->table;
+    auto const& keys = data->keys;
+    random_generator random{std::uint64_t(state.thread_index()) + 1};
+    omega::latency_histogram latencies;
+    perf_scope counters;
+    for (auto _ : state)
+    {
+        std::uint64_t const number = random.next();
+        auto const start = std::chrono::steady_clock::now();
+        table.visit(keys[number % keys.size()], [hold_ns, number](value_type& value)
+        {
+            value = number;
+            if (hold_ns == 0)
+                return;
+            auto const until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(hold_ns);
+            while (std::chrono::steady_clock::now() < until)
+            {
+            }
+        });
+        latencies.record(std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count()));
+    }
+    counters.report(state, 1);
+    // Every thread reports the same merged value, averaging over threads keeps it as is
+    auto const tail = merge_tail_latencies(state, latencies);
+    state.counters["p99_ns"] = benchmark::Counter(double(tail.first), benchmark::Counter::kAvgThreads);
+    state.counters["p999_ns"] = benchmark::Counter(double(tail.second), benchmark::Counter::kAvgThreads);
+    state.SetItemsProcessed(state.iterations());
+}
+
+struct table_size
+{
+    char const* name;
+    std::size_t bytes;
+};
+
+std::size_t cache_size(int name, std::size_t fallback)
+{
+    long const size = ::sysconf(name);
+    return size > 0 ? std::size_t(size) : fallback;
+}
+
+// Benchmark names start with the implementation name followed by '/'
+template<typename Table>
+void register_table(char const* implementation, std::string const& suffix, std::size_t entries, int max_threads)
+{
+    std::string const prefix = implementation + ("/" + suffix);
+    for (int read_percent : {100, 95, 50, 0})
+    {
+        benchmark::RegisterBenchmark((prefix + "/read:" + std::to_string(read_percent)).c_str(),
+                                     mixed_operations<Table>, entries, read_percent)
+            ->ThreadRange(1, max_threads)
+            ->UseRealTime();
+    }
+
+    benchmark::RegisterBenchmark((prefix + "/remove_add").c_str(), remove_add<Table>, entries)
+        ->ThreadRange(1, max_threads)
+        ->UseRealTime();
+}
+
+template<typename Key>
+void register_benchmarks(std::vector<table_size> const& sizes, int max_threads)
+{
+    for (auto const& size : sizes)
+    {
+        std::size_t const entries = std::max<std::size_t>(size.bytes / entry_bytes<Key>(), 64);
+        std::string const suffix = std::string{key_traits<Key>::name} + "/" + size.name + ":" + std::to_string(entries);
+        register_table<striped_table<Key>>("striped", suffix, entries, max_threads);
+        register_table<adaptive_table<Key>>("adaptive", suffix, entries, max_threads);
+        register_table<mcs_table<Key>>("mcs", suffix, entries, max_threads);
+        register_table<mutex_table<Key>>("mutex", suffix, entries, max_threads);
+        register_table<shared_mutex_table<Key>>("shared_mutex", suffix, entries, max_threads);
+        register_table<sharded_table<Key>>("sharded", suffix, entries, max_threads);
+    }
+}
+
+// Stripe lock comparison on 8 hot keys, each in a stripe of its own
+void register_hold_time_benchmarks(int max_threads)
+{
+    constexpr std::size_t hot_keys = 8;
+    for (std::size_t hold_ns : {0, 100, 1000, 10000})
+    {
+        std::string const suffix = "int/hot:" + std::to_string(hot_keys) + "/hold:" + std::to_string(hold_ns) + "ns";
+        benchmark::RegisterBenchmark(("striped/" + suffix).c_str(), hold_time<striped_table<int>>, hot_keys, hold_ns)
+            ->ThreadRange(1, max_threads)
+            ->UseRealTime();
+        benchmark::RegisterBenchmark(("adaptive/" + suffix).c_str(), hold_time<adaptive_table<int>>, hot_keys, hold_ns)
+            ->ThreadRange(1, max_threads)
+            ->UseRealTime();
+        benchmark::RegisterBenchmark(("mcs/" + suffix).c_str(), hold_time<mcs_table<int>>, hot_keys, hold_ns)
+            ->ThreadRange(1, max_threads)
+            ->UseRealTime();
+    }
+}
+
+// Forwards everything to the default display reporter and prints the throughput of the striped
+// table relative to every baseline once all benchmarks ran. The table goes to stderr so that
+// --benchmark_format=json output stays valid
+class speedup_reporter : public benchmark::BenchmarkReporter
+{
+    // Owned by the library, it hands out the same reporter on every call
+    benchmark::BenchmarkReporter* m_display = benchmark::CreateDefaultDisplayReporter();
+    std::vector<std::string> m_names;
+    std::map<std::string, std::map<std::string, double>> m_throughput;
+
+public:
+    bool ReportContext(Context const& context) override
+    {
+        return m_display->ReportContext(context);
+    }
+
+    void ReportRuns(std::vector<Run> const& reports) override
+    {
+        m_display->ReportRuns(reports);
+        for (auto const& run : reports)
+        {
+            auto const counter = run.counters.find("items_per_second");
+            if (run.run_type != Run::RT_Iteration || run.error_occurred || counter == run.counters.end())
+                continue;
+
+            std::string const name = run.benchmark_name();
+            std::size_t const separator = name.find('/');
+            std::string const workload = name.substr(separator + 1);
+            if (m_throughput.find(workload) == m_throughput.end())
+                m_names.push_back(workload);
+            m_throughput[workload][name.substr(0, separator)] = counter->second.value;
+        }
+    }
+
+    void Finalize() override
+    {
+        m_display->Finalize();
+        char const* const baselines[] = {"adaptive", "mcs", "mutex", "shared_mutex", "sharded"};
+        std::fprintf(stderr, "\n%-60s %14s %12s %12s %12s %12s %12s\n", "speedup of striped over", "striped ops/s", baselines[0],
+                     baselines[1], baselines[2], baselines[3], baselines[4]);
+        for (auto const& name : m_names)
+        {
+            auto const& throughput = m_throughput[name];
+            auto const striped = throughput.find("striped");
+            if (striped == throughput.end())
+                continue;
+
+            std::fprintf(stderr, "%-60s %14.0f", name.c_str(), striped->second);
+            for (char const* baseline : baselines)
+            {
+                auto const other = throughput.find(baseline);
+                if (other != throughput.end() && other->second > 0)
+                    std::fprintf(stderr, " %11.2fx", striped->second / other->second);
+                else
+                    std::fprintf(stderr, " %12s", "-");
+            }
+            std::fprintf(stderr, "\n");
+        }
+    }
+};
+}
+
+// --table_bytes_limit=<bytes> skips table sizes above the limit, --perf_counters adds cycles, instructions,
+// LLC, dTLB and branch misses per operation to every run, all other flags go to Google Benchmark
+int main(int argc, char* argv[])
+{
+    std::size_t bytes_limit = 0;
+    int benchmark_argc = 0;
+    for (int i = 0; i < argc; ++i)
+    {
+        constexpr char const limit_flag[] = "--table_bytes_limit=";
+        if (std::strncmp(argv[i], limit_flag, sizeof(limit_flag) - 1) == 0)
+            bytes_limit = std::strtoull(argv[i] + sizeof(limit_flag) - 1, nullptr, 10);
+        else if (std::strcmp(argv[i], "--perf_counters") == 0)
+            perf_counters_enabled = true;
+        else
+            argv[benchmark_argc++] = argv[i];
+    }
+
+    std::size_t const llc = cache_size(_SC_LEVEL3_CACHE_SIZE, 32 << 20);
+    std::vector<table_size> sizes;
+    for (table_size const& size : {table_size{"L1", cache_size(_SC_LEVEL1_DCACHE_SIZE, 32 << 10)},
+                                   table_size{"L2", cache_size(_SC_LEVEL2_CACHE_SIZE, 1 << 20)},
+                                   table_size{"LLC", llc},
+                                   table_size{"10xLLC", 10 * llc}})
+    {
+        if (bytes_limit == 0 || size.bytes <= bytes_limit)
+            sizes.push_back(size);
+    }
+
+    if (perf_counters_enabled && !omega::perf_counters{}.any_open())
+    {
+        std::fprintf(stderr, "--perf_counters ignored: perf_event_open failed for every counter(no PMU or perf_event_paranoid above 2)\n");
+        perf_counters_enabled = false;
+    }
+
+    int const max_threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    register_benchmarks<int>(sizes, max_threads);
+    register_benchmarks<key16>(sizes, max_threads);
+    register_benchmarks<std::string>(sizes, max_threads);
+    register_hold_time_benchmarks(max_threads);
+
+    benchmark::Initialize(&benchmark_argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(benchmark_argc, argv))
+        return 1;
+    speedup_reporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace omega
+{
+// Log-linear histogram in the spirit of HdrHistogram: every power of two range is split into
+// 2^SUB_BUCKET_BITS linear sub-buckets, so recorded values keep a relative error below 1%.
+// Recording is a couple of shifts and an increment, merge() combines per-thread histograms
+class latency_histogram
+{
+    constexpr static int SUB_BUCKET_BITS = 7;
+    constexpr static std::uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    std::vector<std::uint64_t> m_counts;
+    std::uint64_t m_count = 0;
+    std::uint64_t m_sum = 0;
+    std::uint64_t m_max = 0;
+
+    static std::size_t get_index(std::uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return std::size_t(value);
+
+        int const shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+        return std::size_t((shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS));
+    }
+
+    // Highest value which falls into the bucket
+    static std::uint64_t get_value(std::size_t index)
+    {
+        if (index < SUB_BUCKETS)
+            return index;
+
+        int const shift = int(index / SUB_BUCKETS) - 1;
+        std::uint64_t const sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+        return (sub_bucket << shift) + ((std::uint64_t(1) << shift) - 1);
+    }
+
+public:
+    latency_histogram()
+        : m_counts((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+    {}
+
+    void record(std::uint64_t value)
+    {
+        ++m_counts[get_index(value)];
+        ++m_count;
+        m_sum += value;
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(latency_histogram const& other)
+    {
+        for (std::size_t i = 0; i < m_counts.size(); ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    // percentile in [0, 100], the exact maximum is returned for 100
+    std::uint64_t percentile(double percentile) const
+    {
+        if (m_count == 0)
+            return 0;
+        if (percentile >= 100.0)
+            return m_max;
+
+        std::uint64_t const target = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(percentile / 100.0 * m_count)));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < m_counts.size(); ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= target)
+                return std::min(get_value(i), m_max);
+        }
+
+        return m_max;
+    }
+
+    std::uint64_t count() const
+    {
+        return m_count;
+    }
+
+    std::uint64_t max() const
+    {
+        return m_max;
+    }
+
+    double mean() const
+    {
+        return m_count ? double(m_sum) / m_count : 0.0;
+    }
+};
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace omega
+{
+// Hardware counters of the calling thread, opened with perf_event_open. Every counter is a separate
+// event so that one the CPU or the kernel refuses does not take the others down with it, values are
+// scaled by time_enabled/time_running when the PMU had to multiplex them. Only user space is counted,
+// which works with the default perf_event_paranoid of 2
+class perf_counters
+{
+public:
+    enum counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        LLC_MISSES,
+        DTLB_MISSES,
+        BRANCH_MISSES,
+        COUNTERS
+    };
+
+private:
+    struct read_format
+    {
+        std::uint64_t value;
+        std::uint64_t time_enabled;
+        std::uint64_t time_running;
+    };
+
+    std::array<int, COUNTERS> m_fds;
+
+    static std::uint64_t cache_config(std::uint64_t cache, std::uint64_t operation, std::uint64_t result)
+    {
+        return cache | (operation << 8) | (result << 16);
+    }
+
+    static int open(std::uint32_t type, std::uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+public:
+    perf_counters()
+    {
+        m_fds[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        m_fds[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        m_fds[LLC_MISSES] = open(PERF_TYPE_HW_CACHE,
+            cache_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        m_fds[DTLB_MISSES] = open(PERF_TYPE_HW_CACHE,
+            cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        m_fds[BRANCH_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    }
+
+    perf_counters(perf_counters const& other)=delete;
+    perf_counters& operator=(perf_counters const& other)=delete;
+
+    ~perf_counters()
+    {
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    static char const* name(std::size_t counter)
+    {
+        constexpr char const* names[COUNTERS] = {"cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"};
+        return names[counter];
+    }
+
+    bool is_open(std::size_t counter) const
+    {
+        return m_fds[counter] >= 0;
+    }
+
+    // False if no counter could be opened, e.g. without a PMU in a VM or with perf_event_paranoid above 2
+    bool any_open() const
+    {
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    void start()
+    {
+        for (int fd : m_fds)
+        {
+            if (fd < 0)
+                continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // Counts since start(), 0 for counters which are not open or never got scheduled
+    std::array<double, COUNTERS> stop()
+    {
+        std::array<double, COUNTERS> values{};
+        for (std::size_t i = 0; i < COUNTERS; ++i)
+        {
+            if (m_fds[i] < 0)
+                continue;
+
+            ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            read_format data;
+            if (read(m_fds[i], &data, sizeof(data)) == sizeof(data) && data.time_running > 0)
+                values[i] = double(data.value) * double(data.time_enabled) / double(data.time_running);
+        }
+        return values;
+    }
+};
+}
@@ -0,0 +1,321 @@
+#include "concurrent_lookup_table.h"
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct driver_options
+{
+    std::uint64_t entries = 1000000;
+    std::size_t readers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    std::size_t concurrency = 16;
+    std::size_t capacity = 16;
+    // Retried lookups faster than this are not reported as stalls
+    std::uint64_t stall_threshold_ns = 0;
+    // Thresholds for CI runs, 0 disables the check
+    std::uint64_t max_p99_ns = 0;
+    std::uint64_t max_p999_ns = 0;
+    std::uint64_t max_stall_ns = 0;
+    // Limit of get_value p99.9 while growing over p99.9 in the steady phase, which has no resizes
+    double max_p999_ratio = 0.0;
+    // Limit of the longest stall over the longest resize, a reader should wait for one resize at most
+    double max_stall_ratio = 0.0;
+};
+
+driver_options parse_options(int argc, char* argv[])
+{
+    std::map<std::string, std::string> arguments;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const argument = argv[i];
+        std::size_t const separator = argument.find('=');
+        if (argument.compare(0, 2, "--") != 0 || separator == std::string::npos)
+            throw std::invalid_argument("expected --name=value, got " + argument);
+        arguments[argument.substr(2, separator - 2)] = argument.substr(separator + 1);
+    }
+
+    driver_options options;
+    for (auto const& [name, value] : arguments)
+    {
+        if (name == "entries")
+            options.entries = std::stoull(value);
+        else if (name == "readers")
+            options.readers = std::stoull(value);
+        else if (name == "concurrency")
+            options.concurrency = std::stoull(value);
+        else if (name == "capacity")
+            options.capacity = std::stoull(value);
+        else if (name == "stall_threshold_ns")
+            options.stall_threshold_ns = std::stoull(value);
+        else if (name == "max_p99_ns")
+            options.max_p99_ns = std::stoull(value);
+        else if (name == "max_p999_ns")
+            options.max_p999_ns = std::stoull(value);
+        else if (name == "max_stall_ns")
+            options.max_stall_ns = std::stoull(value);
+        else if (name == "max_p999_ratio")
+            options.max_p999_ratio = std::stod(value);
+        else if (name == "max_stall_ratio")
+            options.max_stall_ratio = std::stod(value);
+        else
+            throw std::invalid_argument("unknown option --" + name);
+    }
+
+    if (options.entries == 0 || options.readers == 0 || options.concurrency == 0)
+        throw std::invalid_argument("entries, readers and concurrency must be positive");
+    return options;
+}
+
+// Counts the lookups of the calling thread which started over because a resize swapped the table
+struct retry_tracer : omega::null_tracer
+{
+    static std::uint64_t& retries()
+    {
+        thread_local std::uint64_t count = 0;
+        return count;
+    }
+
+    static void table_replaced()
+    {
+        ++retries();
+    }
+};
+
+using table_type = omega::concurrent_lookup_table<std::uint64_t, std::uint64_t, 4, std::hash<std::uint64_t>, retry_tracer>;
+using clock_type = std::chrono::steady_clock;
+
+std::uint64_t elapsed_ns(clock_type::time_point start, clock_type::time_point finish)
+{
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+}
+
+// A lookup which waited for a resize and retried on the new table, kept to be matched against resizes
+struct stall
+{
+    std::uint64_t start;
+    std::uint64_t duration;
+};
+
+struct resize_event
+{
+    std::size_t buckets_before;
+    std::size_t buckets_after;
+    std::uint64_t start;
+    std::uint64_t duration;
+    std::uint64_t longest_stall = 0;
+};
+
+struct reader_result
+{
+    omega::latency_histogram latencies;
+    omega::latency_histogram steady_latencies;
+    std::vector<stall> stalls;
+};
+
+std::size_t get_buckets_count(table_type const& table)
+{
+    return std::atomic_load_explicit(&table.m_table, std::memory_order_acquire)->get_buckets_size();
+}
+
+// Reads keys inserted so far until the writer is done, lookups after the table stopped growing count as steady
+void run_reader(table_type const& table, std::atomic<std::uint64_t> const& inserted, std::atomic_bool const& steady,
+                std::atomic_bool const& done, clock_type::time_point origin, std::uint64_t stall_threshold_ns,
+                std::size_t seed, reader_result& result)
+{
+    std::mt19937_64 random{seed};
+    while (!done.load(std::memory_order_relaxed))
+    {
+        bool const growing = !steady.load(std::memory_order_relaxed);
+        std::uint64_t const items = std::max<std::uint64_t>(inserted.load(std::memory_order_relaxed), 1);
+        std::uint64_t const key = random() % items;
+        std::uint64_t const retries = retry_tracer::retries();
+        auto const start = clock_type::now();
+        table.get_value(key);
+        auto const finish = clock_type::now();
+        std::uint64_t const latency = elapsed_ns(start, finish);
+        if (!growing)
+        {
+            result.steady_latencies.record(latency);
+            continue;
+        }
+        result.latencies.record(latency);
+        // A slow lookup which did not retry was preempted or waited for the writer's stripe, not for a resize
+        if (retry_tracer::retries() != retries && latency >= stall_threshold_ns)
+            result.stalls.push_back(stall{elapsed_ns(origin, start), latency});
+    }
+}
+
+bool check_threshold(char const* name, std::uint64_t value, std::uint64_t threshold)
+{
+    if (threshold == 0 || value <= threshold)
+        return true;
+
+    std::fprintf(stderr, "%s %llu ns exceeds the threshold of %llu ns\n", name, static_cast<unsigned long long>(value),
+                 static_cast<unsigned long long>(threshold));
+    return false;
+}
+
+bool check_ratio(char const* name, double value, double threshold)
+{
+    if (threshold <= 0.0 || value <= threshold)
+        return true;
+
+    std::fprintf(stderr, "%s %.1f exceeds the threshold of %.1f\n", name, value, threshold);
+    return false;
+}
+}
+
+// A single writer grows the table from capacity to entries while readers look up inserted keys and record
+// their latency. Prints reader latency percentiles and every resize with the longest reader stall during it,
+// a stall being a lookup which retried because the resize swapped the table. The writer then updates the
+// inserted keys for as long as the growth took, the readers' latency in this steady phase is the baseline.
+// Options: --entries=N --readers=N --concurrency=mutexes --capacity=buckets --stall_threshold_ns=N
+// and --max_p99_ns=N --max_p999_ns=N --max_stall_ns=N --max_p999_ratio=X --max_stall_ratio=X which make the
+// run fail with exit code 2 when exceeded
+int main(int argc, char* argv[])
+{
+    try
+    {
+        driver_options const options = parse_options(argc, argv);
+        table_type table(options.concurrency, options.capacity);
+
+        std::atomic<std::uint64_t> inserted{0};
+        std::atomic_bool steady{false};
+        std::atomic_bool done{false};
+        std::vector<reader_result> results(options.readers);
+        std::vector<std::thread> readers;
+        auto const origin = clock_type::now();
+        for (std::size_t i = 0; i < options.readers; ++i)
+        {
+            readers.emplace_back(run_reader, std::cref(table), std::cref(inserted), std::cref(steady), std::cref(done),
+                                 origin, options.stall_threshold_ns, i + 1, std::ref(results[i]));
+        }
+
+        // The writer is the only thread adding keys, so a change of the bucket count means its insert ran the resize
+        omega::latency_histogram inserts;
+        std::vector<resize_event> resizes;
+        std::size_t buckets = get_buckets_count(table);
+        for (std::uint64_t i = 0; i < options.entries; ++i)
+        {
+            auto const start = clock_type::now();
+            table.add_or_update(i, i);
+            auto const finish = clock_type::now();
+            inserted.store(i + 1, std::memory_order_relaxed);
+            inserts.record(elapsed_ns(start, finish));
+
+            std::size_t const new_buckets = get_buckets_count(table);
+            if (new_buckets != buckets)
+            {
+                resizes.push_back(resize_event{buckets, new_buckets, elapsed_ns(origin, start), elapsed_ns(start, finish)});
+                buckets = new_buckets;
+            }
+        }
+        auto const grown = clock_type::now();
+        double const seconds = std::chrono::duration<double>(grown - origin).count();
+
+        steady.store(true, std::memory_order_relaxed);
+        omega::latency_histogram updates;
+        for (std::uint64_t i = 0; clock_type::now() - grown < grown - origin; ++i)
+        {
+            auto const start = clock_type::now();
+            table.add_or_update(i % options.entries, i);
+            updates.record(elapsed_ns(start, clock_type::now()));
+        }
+        done.store(true, std::memory_order_relaxed);
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+
+        omega::latency_histogram reads;
+        omega::latency_histogram steady_reads;
+        for (auto const& result : results)
+        {
+            reads.merge(result.latencies);
+            steady_reads.merge(result.steady_latencies);
+            for (auto const& stall : result.stalls)
+            {
+                for (auto& resize : resizes)
+                {
+                    if (stall.start < resize.start + resize.duration && stall.start + stall.duration > resize.start)
+                        resize.longest_stall = std::max(resize.longest_stall, stall.duration);
+                }
+            }
+        }
+
+        std::uint64_t longest_stall = 0;
+        std::uint64_t longest_resize = 0;
+        for (auto const& resize : resizes)
+        {
+            longest_stall = std::max(longest_stall, resize.longest_stall);
+            longest_resize = std::max(longest_resize, resize.duration);
+        }
+
+        std::printf("%llu entries, %zu readers, %zu resizes in %.3f s\n", static_cast<unsigned long long>(options.entries),
+                    options.readers, resizes.size(), seconds);
+        std::printf("%-18s %12s %10s %10s %10s %10s %12s\n", "operation", "count", "mean ns", "p50 ns", "p99 ns",
+                    "p99.9 ns", "max ns");
+        for (auto const& [name, latencies] : {std::make_pair("get_value", &reads), std::make_pair("add_or_update", &inserts),
+                                              std::make_pair("steady get_value", &steady_reads),
+                                              std::make_pair("steady update", &updates)})
+        {
+            if (latencies->count() == 0)
+                continue;
+            std::printf("%-18s %12llu %10.0f %10llu %10llu %10llu %12llu\n", name,
+                        static_cast<unsigned long long>(latencies->count()), latencies->mean(),
+                        static_cast<unsigned long long>(latencies->percentile(50)),
+                        static_cast<unsigned long long>(latencies->percentile(99)),
+                        static_cast<unsigned long long>(latencies->percentile(99.9)),
+                        static_cast<unsigned long long>(latencies->max()));
+        }
+
+        std::printf("\n%-8s %12s %12s %14s %14s %18s\n", "resize", "buckets", "new buckets", "start us", "duration ns",
+                    "longest stall ns");
+        for (std::size_t i = 0; i < resizes.size(); ++i)
+        {
+            auto const& resize = resizes[i];
+            std::printf("%-8zu %12zu %12zu %14llu %14llu %18llu\n", i + 1, resize.buckets_before, resize.buckets_after,
+                        static_cast<unsigned long long>(resize.start / 1000),
+                        static_cast<unsigned long long>(resize.duration),
+                        static_cast<unsigned long long>(resize.longest_stall));
+        }
+
+        bool passed = check_threshold("get_value p99", reads.percentile(99), options.max_p99_ns);
+        passed = check_threshold("get_value p99.9", reads.percentile(99.9), options.max_p999_ns) && passed;
+        passed = check_threshold("longest stall during a resize", longest_stall, options.max_stall_ns) && passed;
+        if (longest_resize > 0)
+        {
+            passed = check_ratio("longest stall over longest resize", double(longest_stall) / double(longest_resize),
+                                 options.max_stall_ratio) && passed;
+        }
+        if (steady_reads.count() > 0)
+        {
+            passed = check_ratio("get_value p99.9 over steady p99.9",
+                                 double(reads.percentile(99.9)) / double(std::max<std::uint64_t>(steady_reads.percentile(99.9), 1)),
+                                 options.max_p999_ratio) && passed;
+        }
+        if (!passed)
+            return 2;
+    }
+    catch (std::exception const& error)
+    {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+
+    return 0;
+}
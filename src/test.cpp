@@ -1,7 +1,27 @@
+#include "allocation_counter.h"
+#include "bulk_import.h"
 #include "concurrent_lookup_table.h"
+#include "config_advisor.h"
+#include "metrics_exporter.h"
+#include "shared_lookup_table.h"
+#include "tiered_lookup_table.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 #include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 TEST(LookupTable, WriteReadValue)
 {
@@ -209,6 +229,1127 @@ TEST(LookupTable, ParrallelWriteRemoveReadValues)
     thread2.join();
 }
 
+TEST(LookupTable, SaveLoadSnapshot)
+{
+    std::string const path = testing::TempDir() + "lookup_table.snapshot";
+    omega::concurrent_lookup_table<int, std::string> table(64, 256);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, "value = " + std::to_string(i));
+    }
+    table.save_snapshot(path);
+
+    omega::concurrent_lookup_table<int, std::string> restored(64, 256);
+    restored.load_snapshot(path, 4);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EXPECT_EQ(restored.get_value(i).value(), "value = " + std::to_string(i));
+    }
+    EXPECT_FALSE(restored.get_value(10000).has_value());
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, SaveLoadSnapshotDirectIo)
+{
+    std::string const path = testing::TempDir() + "lookup_table.direct.snapshot";
+    int const probe = ::open(path.c_str(), O_WRONLY | O_CREAT | O_DIRECT, 0644);
+    if (probe < 0)
+        GTEST_SKIP() << testing::TempDir() << " does not support O_DIRECT";
+    ::close(probe);
+
+    omega::concurrent_lookup_table<int, std::string> table(64, 256);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, "value = " + std::to_string(i));
+    }
+    omega::snapshot_options options;
+    options.threads = 4;
+    options.direct_io = true;
+    table.save_snapshot(path, options);
+
+    omega::concurrent_lookup_table<int, std::string> restored(64, 256);
+    EXPECT_EQ(restored.load_snapshot(path, options).entry_count, 10000);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EXPECT_EQ(restored.get_value(i).value(), "value = " + std::to_string(i));
+    }
+
+    // A snapshot written without O_DIRECT loads through it as well
+    table.save_snapshot(path);
+    omega::concurrent_lookup_table<int, std::string> buffered(64, 256);
+    EXPECT_EQ(buffered.load_snapshot(path, options).entry_count, 10000);
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, LoadSnapshotRejectsForeignFile)
+{
+    std::string const path = testing::TempDir() + "lookup_table.foreign";
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fputs("definitely not a snapshot", file);
+    std::fclose(file);
+
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    EXPECT_THROW(table.load_snapshot(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, MappedSnapshotServesValues)
+{
+    std::string const path = testing::TempDir() + "lookup_table.mapped";
+    omega::concurrent_lookup_table<int, double> table(64, 256);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, i * 0.5);
+    }
+    table.save_mapped_snapshot(path);
+
+    omega::mapped_lookup_table<int, double> view(path);
+    EXPECT_EQ(view.size(), 10000);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EXPECT_EQ(view.get_value(i).value(), i * 0.5);
+    }
+    EXPECT_FALSE(view.get_value(-1).has_value());
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, RecoverFromMutationLog)
+{
+    std::string const path = testing::TempDir() + "lookup_table.log";
+    std::remove(path.c_str());
+    {
+        omega::concurrent_lookup_table<int, std::string> table(64, 256);
+        table.attach_log(std::make_shared<omega::mutation_log<int, std::string>>(path));
+
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([&table, t]()
+            {
+                for (int i = t; i < 4000; i += 4)
+                {
+                    table.add_or_update(i, "value = " + std::to_string(i));
+                    if (i % 3 == 0)
+                        table.remove(i);
+                }
+            });
+        }
+
+        for (auto& writer : writers)
+        {
+            writer.join();
+        }
+    }
+
+    omega::concurrent_lookup_table<int, std::string> recovered(64, 256);
+    EXPECT_EQ(recovered.recover_from_log(path), 4000 + 4000 / 3 + 1);
+    for (int i = 0; i < 4000; ++i)
+    {
+        if (i % 3 == 0)
+            EXPECT_FALSE(recovered.get_value(i).has_value());
+        else
+            EXPECT_EQ(recovered.get_value(i).value(), "value = " + std::to_string(i));
+    }
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, ReopenedMutationLogResumesAfterGap)
+{
+    std::string const path = testing::TempDir() + "lookup_table.gap.log";
+    std::remove(path.c_str());
+    {
+        omega::mutation_log<int, int> log(path);
+        for (int i = 0; i < 10; ++i)
+        {
+            EXPECT_EQ(log.append_update(i, i), std::uint64_t(i));
+        }
+        log.wait_durable(9);
+        EXPECT_GE(log.durable_lsn(), 10);
+    }
+
+    // A crash between two group commits: lsn 5 never reached the file, 6 to 9 did
+    {
+        std::ifstream input{path, std::ios::binary};
+        std::vector<char> const bytes{std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{}};
+        std::vector<char> kept;
+        char const* cursor = bytes.data();
+        char const* const end = bytes.data() + bytes.size();
+        omega::log_record<int, int> record{};
+        while (cursor != end)
+        {
+            char const* const start = cursor;
+            ASSERT_TRUE(omega::read_log_record(cursor, end, record));
+            if (record.lsn != 5)
+                kept.insert(kept.end(), start, cursor);
+        }
+        std::ofstream output{path, std::ios::binary | std::ios::trunc};
+        output.write(kept.data(), std::streamsize(kept.size()));
+    }
+
+    {
+        omega::mutation_log<int, int> log(path);
+        EXPECT_EQ(log.next_lsn(), 5);
+        for (int i = 100; i < 103; ++i)
+        {
+            log.append_update(i, i);
+        }
+    }
+
+    omega::concurrent_lookup_table<int, int> recovered(4, 16);
+    EXPECT_EQ(recovered.recover_from_log(path), 8);
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(recovered.get_value(i).value(), i);
+    }
+    for (int i = 5; i < 10; ++i)
+    {
+        EXPECT_FALSE(recovered.get_value(i).has_value());
+    }
+    for (int i = 100; i < 103; ++i)
+    {
+        EXPECT_EQ(recovered.get_value(i).value(), i);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, FuzzyCheckpointWithLogRecovery)
+{
+    std::string const snapshot_path = testing::TempDir() + "lookup_table.checkpoint";
+    std::string const log_path = testing::TempDir() + "lookup_table.checkpoint.log";
+    std::remove(log_path.c_str());
+    {
+        omega::concurrent_lookup_table<int, int> table(64, 256);
+        table.attach_log(std::make_shared<omega::mutation_log<int, int>>(log_path));
+        for (int i = 0; i < 5000; ++i)
+        {
+            table.add_or_update(i, i);
+        }
+
+        auto checkpoint = table.start_checkpoint(snapshot_path);
+        for (int i = 0; i < 5000; ++i)
+        {
+            table.add_or_update(i, -i);
+        }
+        EXPECT_GE(checkpoint.get().log_lsn, 5000);
+    }
+
+    omega::concurrent_lookup_table<int, int> recovered(64, 256);
+    recovered.recover(snapshot_path, log_path);
+    for (int i = 0; i < 5000; ++i)
+    {
+        EXPECT_EQ(recovered.get_value(i).value(), -i);
+    }
+    std::remove(snapshot_path.c_str());
+    std::remove(log_path.c_str());
+}
+
+TEST(LookupTable, SnapshotViaFork)
+{
+    std::string const path = testing::TempDir() + "lookup_table.forked";
+    omega::concurrent_lookup_table<int, std::string> table(64, 256);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, std::to_string(i));
+    }
+
+    pid_t const child = table.snapshot_via_fork(path);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, "changed");
+    }
+    ASSERT_TRUE(table.wait_for_snapshot(child));
+
+    omega::concurrent_lookup_table<int, std::string> restored(64, 256);
+    EXPECT_EQ(restored.load_snapshot(path).entry_count, 10000);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EXPECT_EQ(restored.get_value(i).value(), std::to_string(i));
+    }
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, FailedForkSnapshotKeepsStripesDirty)
+{
+    std::string const delta_path = testing::TempDir() + "lookup_table.fork.delta";
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.save_delta_snapshot(delta_path);
+    table.add_or_update(7, 70);
+
+    // The child cannot create the file and fails
+    pid_t const child = table.snapshot_via_fork(testing::TempDir() + "missing/directory/snapshot");
+    EXPECT_FALSE(table.wait_for_snapshot(child));
+
+    omega::snapshot_info const delta = table.save_delta_snapshot(delta_path);
+    EXPECT_GT(delta.entry_count, 0);
+    EXPECT_LT(delta.entry_count, 1000);
+    std::remove(delta_path.c_str());
+}
+
+TEST(LookupTable, FailedSaveKeepsStripesDirty)
+{
+    // Every write to /dev/full fails with ENOSPC after the file opened
+    if (access("/dev/full", W_OK) != 0)
+        GTEST_SKIP() << "no /dev/full";
+
+    std::string const delta_path = testing::TempDir() + "lookup_table.failed.delta";
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.save_delta_snapshot(delta_path);
+    table.add_or_update(7, 70);
+
+    EXPECT_THROW(table.save_delta_snapshot("/dev/full"), std::system_error);
+    EXPECT_THROW(table.save_snapshot("/dev/full"), std::system_error);
+
+    omega::snapshot_info const delta = table.save_delta_snapshot(delta_path);
+    EXPECT_GT(delta.entry_count, 0);
+    EXPECT_LT(delta.entry_count, 1000);
+    std::remove(delta_path.c_str());
+}
+
+TEST(LookupTable, Crc32cCheckValue)
+{
+    EXPECT_EQ(omega::crc32c("123456789", 9), 0xE3069283u);
+    EXPECT_EQ(omega::crc32c("56789", 5, omega::crc32c("1234", 4)), 0xE3069283u);
+}
+
+TEST(LookupTable, CorruptedSnapshotChunkIsDetected)
+{
+    std::string const path = testing::TempDir() + "lookup_table.corrupted";
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.save_snapshot(path);
+
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    std::fseek(file, omega::SNAPSHOT_ALIGNMENT + 8, SEEK_SET);
+    std::fputc(0x5A, file);
+    std::fclose(file);
+
+    omega::concurrent_lookup_table<int, int> restored(64, 256);
+    EXPECT_THROW(restored.load_snapshot(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, DeltaSnapshotsCompactIntoBase)
+{
+    std::string const base_path = testing::TempDir() + "lookup_table.base";
+    std::string const delta1_path = testing::TempDir() + "lookup_table.delta1";
+    std::string const delta2_path = testing::TempDir() + "lookup_table.delta2";
+    std::string const compacted_path = testing::TempDir() + "lookup_table.compacted";
+    using table_type = omega::concurrent_lookup_table<int, int>;
+    table_type table(64, 4096);
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.save_snapshot(base_path);
+
+    table.add_or_update(7, -7);
+    table.remove(8);
+    EXPECT_LE(table.save_delta_snapshot(delta1_path).entry_count, 10000 / 32);
+
+    table.add_or_update(7, 70);
+    table.add_or_update(20000, 1);
+    table.save_delta_snapshot(delta2_path);
+
+    table_type::compact_snapshots(base_path, {delta1_path, delta2_path}, compacted_path);
+    table_type restored(64, 256);
+    EXPECT_EQ(restored.load_snapshot(compacted_path).entry_count, 10000);
+    EXPECT_EQ(restored.get_value(7).value(), 70);
+    EXPECT_FALSE(restored.get_value(8).has_value());
+    EXPECT_EQ(restored.get_value(20000).value(), 1);
+    EXPECT_EQ(restored.get_value(9999).value(), 9999);
+    for (const auto& path : {base_path, delta1_path, delta2_path, compacted_path})
+    {
+        std::remove(path.c_str());
+    }
+}
+
+TEST(LookupTable, SharedMemoryTableAcrossProcesses)
+{
+    std::string const name = "/omega_lookup_table_" + std::to_string(::getpid());
+    using shared_table = omega::shared_lookup_table<int, long>;
+    shared_table::unlink(name);
+    shared_table table(name, 16, 256, 2000);
+
+    pid_t const child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+    {
+        shared_table writer(name, 1, 1, 1);
+        for (int i = 0; i < 1000; ++i)
+        {
+            writer.add_or_update(i, i * 10L);
+        }
+        writer.remove(500);
+        ::_exit(0);
+    }
+
+    int status = 0;
+    ::waitpid(child, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (i == 500)
+            EXPECT_FALSE(table.get_value(i).has_value());
+        else
+            EXPECT_EQ(table.get_value(i).value(), i * 10L);
+    }
+
+    for (int i = 1000; i < 2001; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    EXPECT_THROW(table.add_or_update(5000, 0), std::length_error);
+    shared_table::unlink(name);
+}
+
+TEST(LookupTable, SharedMemoryTableReusesNodesAcrossStripes)
+{
+    std::string const name = "/omega_lookup_table_pool_" + std::to_string(::getpid());
+    using shared_table = omega::shared_lookup_table<int, long>;
+    shared_table::unlink(name);
+    shared_table table(name, 16, 256, 100);
+    for (int i = 0; i < 100; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    EXPECT_THROW(table.add_or_update(100, 0), std::length_error);
+
+    // The freed nodes came from the first stripes, the new keys hash to others
+    for (int i = 0; i < 50; ++i)
+    {
+        table.remove(i);
+    }
+    for (int i = 1000; i < 1050; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    EXPECT_THROW(table.add_or_update(2000, 0), std::length_error);
+    EXPECT_EQ(table.get_value(1049).value(), 1049);
+    shared_table::unlink(name);
+}
+
+TEST(LookupTable, SharedMemoryAttachGivesUpOnDeadCreator)
+{
+    std::string const name = "/omega_lookup_table_dead_" + std::to_string(::getpid());
+    using shared_table = omega::shared_lookup_table<int, long>;
+    shared_table::unlink(name);
+
+    // A creator which died after sizing the segment never marks it ready
+    int const fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::ftruncate(fd, 4096), 0);
+    ::close(fd);
+
+    EXPECT_THROW(shared_table(name, 16, 256, 100, std::chrono::milliseconds{50}), std::runtime_error);
+    shared_table::unlink(name);
+}
+
+TEST(LookupTable, TieredTableSpillsColdValues)
+{
+    // A spilled entry costs the same whatever the size of the value
+    static_assert(sizeof(omega::tiered_slot<std::array<char, 4096>>) == sizeof(omega::tiered_slot<char>));
+    std::string const path = testing::TempDir() + "lookup_table.values";
+    omega::tiered_lookup_table<int, std::string> table(path, 64, 256);
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, "value = " + std::to_string(i));
+    }
+
+    EXPECT_EQ(table.evict(100), 900);
+    EXPECT_GT(table.value_log_size(), 0);
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(table.get_value(i).value(), "value = " + std::to_string(i));
+    }
+
+    std::uint64_t const log_size = table.value_log_size();
+    EXPECT_EQ(table.evict(0), 1000);
+    std::size_t const max_record_size = sizeof(std::uint32_t) + sizeof(std::uint64_t) + std::string("value = 999").size();
+    EXPECT_LE(table.value_log_size() - log_size, 100 * max_record_size);
+    table.remove(5);
+    EXPECT_FALSE(table.get_value(5).has_value());
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, TieredTableCompactsValueLog)
+{
+    std::string const path = testing::TempDir() + "lookup_table.compacted.values";
+    omega::tiered_lookup_table<int, std::string> table(path, 64, 256);
+    for (int round = 0; round < 5; ++round)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            table.add_or_update(i, "round " + std::to_string(round) + " value = " + std::to_string(i));
+        }
+        EXPECT_EQ(table.evict(0), 1000);
+    }
+
+    // Only the last round is live, readers keep going while the keys move to the new log
+    std::uint64_t const log_size = table.value_log_size();
+    std::thread reader([&table]
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            EXPECT_EQ(table.get_value(i).value(), "round 4 value = " + std::to_string(i));
+        }
+    });
+    std::uint64_t const reclaimed = table.compact();
+    reader.join();
+    EXPECT_EQ(reclaimed, log_size - table.value_log_size());
+    EXPECT_LE(table.value_log_size() * 4, log_size);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(table.get_value(i).value(), "round 4 value = " + std::to_string(i));
+    }
+    // Faulted in values keep their records, neither compacting nor spilling them again appends
+    std::uint64_t const compacted_size = table.value_log_size();
+    EXPECT_EQ(table.compact(), 0);
+    EXPECT_EQ(table.evict(0), 1000);
+    EXPECT_EQ(table.value_log_size(), compacted_size);
+    table.remove(7);
+    EXPECT_GT(table.compact(), 0);
+    EXPECT_FALSE(table.get_value(7).has_value());
+    EXPECT_EQ(table.get_value(8).value(), "round 4 value = 8");
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, TieredEvictionRacesUpdates)
+{
+    std::string const path = testing::TempDir() + "lookup_table.racing.values";
+    omega::tiered_lookup_table<int, std::string> table(path, 64, 256);
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, "old " + std::to_string(i));
+    }
+
+    std::thread writer([&table]
+    {
+        std::uint64_t log_size = 0;
+        for (int i = 0; i < 1000; ++i)
+        {
+            table.add_or_update(i, "new " + std::to_string(i));
+            EXPECT_GE(table.value_log_size(), log_size);
+            log_size = table.value_log_size();
+        }
+    });
+    for (int round = 0; round < 10; ++round)
+    {
+        table.evict(0);
+    }
+    writer.join();
+    table.evict(0);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(table.get_value(i).value(), "new " + std::to_string(i));
+    }
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, UntrackedChangesSkipDeltaSnapshot)
+{
+    std::string const path = testing::TempDir() + "lookup_table.untracked.delta";
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.save_delta_snapshot(path);
+
+    table.for_each_untracked([](int const&, int& value) { ++value; });
+    EXPECT_TRUE(table.visit_untracked(7, [](int& value) { ++value; }));
+    EXPECT_EQ(table.save_delta_snapshot(path).entry_count, 0);
+    EXPECT_EQ(table.get_value(7).value(), 9);
+
+    EXPECT_TRUE(table.visit(7, [](int& value) { ++value; }));
+    EXPECT_GT(table.save_delta_snapshot(path).entry_count, 0);
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, BulkImportBinaryAndDelimited)
+{
+    std::string const binary_path = testing::TempDir() + "lookup_table.bin";
+    std::FILE* file = std::fopen(binary_path.c_str(), "wb");
+    for (int i = 0; i < 10000; ++i)
+    {
+        int const record[2] = {i, i * 2};
+        std::fwrite(record, sizeof(record), 1, file);
+    }
+    std::fclose(file);
+
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    auto const binary = omega::import_binary(table, binary_path, {4, 100});
+    EXPECT_EQ(binary.records, 10000);
+    EXPECT_EQ(binary.malformed, 0);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EXPECT_EQ(table.get_value(i).value(), i * 2);
+    }
+
+    std::string const text_path = testing::TempDir() + "lookup_table.csv";
+    file = std::fopen(text_path.c_str(), "wb");
+    for (int i = 0; i < 10000; ++i)
+    {
+        std::fprintf(file, "%d,value = %d\n", i, i);
+    }
+    std::fputs("not a key,value\n\nno delimiter\n", file);
+    std::fclose(file);
+
+    omega::concurrent_lookup_table<int, std::string> text_table(64, 256);
+    auto const text = omega::import_delimited(text_table, text_path, ',', {4, 100});
+    EXPECT_EQ(text.records, 10000);
+    EXPECT_EQ(text.malformed, 2);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EXPECT_EQ(text_table.get_value(i).value(), "value = " + std::to_string(i));
+    }
+    std::remove(binary_path.c_str());
+    std::remove(text_path.c_str());
+}
+
+TEST(LookupTable, BulkImportKeepsLastDuplicate)
+{
+    // Every key repeats in every chunk, the last record in the file wins
+    std::string const binary_path = testing::TempDir() + "lookup_table.duplicates.bin";
+    std::string const text_path = testing::TempDir() + "lookup_table.duplicates.csv";
+    std::FILE* binary = std::fopen(binary_path.c_str(), "wb");
+    std::FILE* text = std::fopen(text_path.c_str(), "wb");
+    for (int i = 0; i < 20000; ++i)
+    {
+        int const record[2] = {i % 500, i};
+        std::fwrite(record, sizeof(record), 1, binary);
+        std::fprintf(text, "%d,%d\n", i % 500, i);
+    }
+    std::fclose(binary);
+    std::fclose(text);
+
+    omega::concurrent_lookup_table<int, int> binary_table(64, 256);
+    EXPECT_EQ(omega::import_binary(binary_table, binary_path, {4, 100}).records, 20000);
+    omega::concurrent_lookup_table<int, int> text_table(64, 256);
+    EXPECT_EQ(omega::import_delimited(text_table, text_path, ',', {4, 100}).records, 20000);
+    for (int key = 0; key < 500; ++key)
+    {
+        EXPECT_EQ(binary_table.get_value(key).value(), 19500 + key);
+        EXPECT_EQ(text_table.get_value(key).value(), 19500 + key);
+    }
+    std::remove(binary_path.c_str());
+    std::remove(text_path.c_str());
+}
+
+TEST(LookupTable, LockStatsPerStripe)
+{
+    omega::concurrent_lookup_table<int, int> table(8, 256);
+    for (int i = 0; i < 100; ++i)
+    {
+        table.add_or_update(i, i);
+        table.get_value(i);
+    }
+
+    omega::lock_stats const stats = table.stats();
+#ifdef OMEGA_LOCK_STATS
+    ASSERT_EQ(stats.stripes.size(), 8);
+    EXPECT_EQ(stats.total().acquires, 200);
+    EXPECT_EQ(stats.total().contended_acquires, 0);
+    EXPECT_EQ(stats.total().wait_ns, 0);
+
+    // A resize starts the stripes from zero, the exported counters keep growing
+    table.reserve(10000);
+    EXPECT_EQ(table.stats().total().acquires, 0);
+    EXPECT_EQ(table.stats().retired.acquires, 200);
+    EXPECT_EQ(table.metrics().contention.acquires, 200);
+    table.get_value(1);
+    EXPECT_EQ(table.metrics().contention.acquires, 201);
+#else
+    EXPECT_TRUE(stats.stripes.empty());
+#endif
+}
+
+TEST(LookupTable, TelemetryTracksResizesAndShape)
+{
+    omega::concurrent_lookup_table<int, int> table(4, 4);
+    omega::table_telemetry const empty = table.telemetry();
+    EXPECT_EQ(empty.resizes, 0);
+    EXPECT_EQ(empty.entries, 0);
+    EXPECT_EQ(empty.chain_lengths[0], empty.buckets);
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.remove(0);
+
+    omega::table_telemetry const telemetry = table.telemetry();
+    EXPECT_GT(telemetry.resizes, 0);
+    EXPECT_GT(telemetry.entries_moved, 0);
+    EXPECT_GE(telemetry.total.rehash_ns, telemetry.last.rehash_ns);
+    EXPECT_EQ(telemetry.entries, 9999);
+    EXPECT_GT(telemetry.locks, 4);
+    EXPECT_DOUBLE_EQ(telemetry.load_factor, 9999.0 / telemetry.buckets);
+    std::size_t buckets = 0;
+    for (std::size_t count : telemetry.chain_lengths)
+    {
+        buckets += count;
+    }
+    EXPECT_EQ(buckets, telemetry.buckets);
+
+    table.reserve(100000);
+    EXPECT_EQ(table.telemetry().resizes, telemetry.resizes + 1);
+}
+
+TEST(LookupTable, ReserveStaysWithinLoadBound)
+{
+    for (std::size_t count : {std::size_t(1000), std::size_t(100000), std::size_t(1000000), std::size_t(80000000)})
+    {
+        for (std::size_t max_load_factor : {2, 4, 8})
+        {
+            std::size_t const capacity = omega::reserve_capacity(count, max_load_factor);
+            EXPECT_GE(capacity, 2 * count / max_load_factor) << count << " entries";
+            EXPECT_LE(capacity, 4 * count / max_load_factor + 1) << count << " entries";
+        }
+    }
+
+    for (std::size_t count : {1000, 10000, 100000})
+    {
+        omega::concurrent_lookup_table<std::string, int> grown(16, 16);
+        omega::concurrent_lookup_table<std::string, int> reserved(16, 16);
+        reserved.reserve(count);
+        std::uint64_t const resizes = reserved.telemetry().resizes;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            grown.add_or_update("key " + std::to_string(i), int(i));
+            reserved.add_or_update("key " + std::to_string(i), int(i));
+        }
+        EXPECT_LE(reserved.telemetry().resizes - resizes, 3) << count << " entries";
+        EXPECT_LT(reserved.telemetry().resizes - resizes, grown.telemetry().resizes) << count << " entries";
+    }
+}
+
+TEST(LookupTable, HotKeysFindMostAccessedKeys)
+{
+    omega::concurrent_lookup_table<int, int> table(64, 256);
+    EXPECT_TRUE(table.hot_keys(3).empty());
+    table.track_hot_keys({3, 16, 32});
+
+    auto access = [&table](int thread)
+    {
+        for (int i = 0; i < 20000; ++i)
+        {
+            int const key = i % 4 == 0 ? 100 * (i / 4 % 3) : 1000 + thread * 10000 + i;
+            table.add_or_update(key, i);
+            table.get_value(key);
+        }
+    };
+    std::thread thread1(access, 1);
+    std::thread thread2(access, 2);
+    thread1.join();
+    thread2.join();
+
+    auto const hot = table.hot_keys(3);
+    ASSERT_EQ(hot.size(), 3);
+    std::vector<int> keys;
+    for (auto const& key : hot)
+    {
+        keys.push_back(key.key);
+        EXPECT_GE(key.count, key.error);
+    }
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(keys, (std::vector<int>{0, 100, 200}));
+}
+
+struct counting_tracer : omega::null_tracer
+{
+    static inline int acquired = 0;
+    static inline int released = 0;
+    static inline std::size_t probes = 0;
+    static inline int resizes_started = 0;
+    static inline int resizes_finished = 0;
+    static inline int evictions = 0;
+
+    static void lock_acquired(std::size_t) { ++acquired; }
+    static void lock_released(std::size_t) { ++released; }
+    static void probed(std::size_t length) { probes += length; }
+    static void resize_started(std::size_t) { ++resizes_started; }
+    static void resize_finished(std::size_t, std::size_t) { ++resizes_finished; }
+    static void evicted() { ++evictions; }
+};
+
+TEST(LookupTable, TracerHooksAreCalled)
+{
+    omega::concurrent_lookup_table<int, int, 4, std::hash<int>, counting_tracer> table(4, 4);
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    EXPECT_EQ(table.get_value(7).value(), 7);
+
+    EXPECT_EQ(counting_tracer::acquired, 1001);
+    EXPECT_EQ(counting_tracer::released, 1001);
+    EXPECT_GT(counting_tracer::probes, 0);
+    EXPECT_GT(counting_tracer::resizes_started, 0);
+    EXPECT_EQ(counting_tracer::resizes_started, counting_tracer::resizes_finished);
+    EXPECT_EQ(counting_tracer::resizes_started, table.telemetry().resizes);
+
+    std::string const path = testing::TempDir() + "lookup_table.traced";
+    omega::tiered_lookup_table<int, std::string, 4, std::hash<int>, counting_tracer> tiered(path, 64, 256);
+    for (int i = 0; i < 100; ++i)
+    {
+        tiered.add_or_update(i, "value");
+    }
+    EXPECT_EQ(tiered.evict(10), 90);
+    EXPECT_EQ(counting_tracer::evictions, 90);
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, MetricsExportedInPrometheusFormat)
+{
+    omega::concurrent_lookup_table<int, int> table(4, 4);
+    table.enable_metrics();
+    for (int i = 0; i < 1000; ++i)
+    {
+        table.add_or_update(i, i);
+    }
+    table.add_or_update(0, 1);
+    table.add_or_update_batch({{1000, 0}, {1, 0}});
+    table.remove(1);
+    table.remove(-1);
+    table.get_value(0);
+    table.get_value(-1);
+
+    omega::table_metrics const metrics = table.metrics();
+    EXPECT_EQ(metrics.add_or_updates, 1003);
+    EXPECT_EQ(metrics.inserts, 1001);
+    EXPECT_EQ(metrics.removes, 2);
+    EXPECT_EQ(metrics.removed, 1);
+    EXPECT_EQ(metrics.get_values, 2);
+    EXPECT_EQ(metrics.get_value_hits, 1);
+    EXPECT_EQ(metrics.entries, 1000);
+    EXPECT_GT(metrics.resizes, 0);
+    EXPECT_EQ(metrics.buckets, table.telemetry().buckets);
+
+    std::string const path = testing::TempDir() + "lookup_table.prom";
+    std::remove(path.c_str());
+    omega::metrics_exporter_options options;
+    options.path = path;
+    options.serve_http = true;
+    omega::metrics_exporter exporter(table, options);
+    ASSERT_NE(exporter.port(), 0);
+
+    std::string text;
+    for (int attempt = 0; attempt < 100 && text.empty(); ++attempt)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{20});
+        std::ifstream file{path};
+        std::stringstream content;
+        content << file.rdbuf();
+        text = content.str();
+    }
+    EXPECT_NE(text.find("# TYPE omega_lookup_table_entries gauge\nomega_lookup_table_entries 1000\n"), std::string::npos);
+
+    int const fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(exporter.port());
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    std::string const request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+    std::string response;
+    char buffer[4096];
+    for (ssize_t size; (size = ::recv(fd, buffer, sizeof(buffer), 0)) > 0;)
+    {
+        response.append(buffer, std::size_t(size));
+    }
+    ::close(fd);
+    EXPECT_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0);
+    EXPECT_NE(response.find("omega_lookup_table_inserts_total 1001\n"), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, TraceRecordsOperationsInOrder)
+{
+    omega::concurrent_lookup_table<int, std::string> table(64, 256);
+    auto trace = std::make_shared<omega::trace_recorder<int, std::string>>(omega::trace_options{100});
+    table.attach_trace(trace);
+    table.add_or_update(1, "abc");
+    table.get_value(1);
+    table.remove(1);
+
+    std::thread writer([&table]()
+    {
+        for (int i = 0; i < 200; ++i)
+        {
+            table.add_or_update(i, "value");
+        }
+    });
+    writer.join();
+
+    std::string const path = testing::TempDir() + "lookup_table.trace";
+    EXPECT_EQ(trace->save(path), 103);
+    omega::workload_trace const saved = omega::read_trace(path);
+    EXPECT_EQ(saved.header.dropped, 100);
+    EXPECT_EQ(saved.header.flags, omega::TRACE_EXACT_KEYS);
+    ASSERT_EQ(saved.records.size(), 103);
+    EXPECT_EQ(saved.records[0].operation, omega::trace_operation::add_or_update);
+    EXPECT_EQ(saved.records[0].key, 1);
+    EXPECT_EQ(saved.records[0].value_size, 3);
+    EXPECT_EQ(saved.records[1].operation, omega::trace_operation::get_value);
+    EXPECT_EQ(saved.records[2].operation, omega::trace_operation::remove);
+    EXPECT_EQ(saved.records[3].key, 100);
+    EXPECT_EQ(saved.records[3].thread, 1);
+    EXPECT_EQ(saved.records[102].key, 199);
+    for (std::size_t i = 1; i < saved.records.size(); ++i)
+    {
+        EXPECT_LE(saved.records[i - 1].timestamp_ns, saved.records[i].timestamp_ns);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(LookupTable, AdvisedCapacityAvoidsResizes)
+{
+    omega::table_config const config{4, 4, true, 4};
+    omega::concurrent_lookup_table<int, int> table(config.concurrency, config.capacity, config.grow_concurrency_on_resize);
+    table.enable_metrics();
+    for (int i = 0; i < 2000; ++i)
+    {
+        table.add_or_update(i, i);
+        table.get_value(i);
+    }
+
+    omega::advisor_options options;
+    options.load_factors = {4};
+    omega::config_advice const advice = omega::advise(omega::observe(table, config), options);
+    EXPECT_GT(advice.resizes_avoided, 0);
+    EXPECT_EQ(advice.resizes_avoided, table.telemetry().resizes);
+    EXPECT_EQ(advice.config.max_load_factor, 4);
+    EXPECT_GE(advice.config.capacity, 2000 / 4);
+    EXPECT_GE(advice.config.concurrency, config.concurrency);
+    // The table grew its stripes, which says nothing about contention
+    EXPECT_GT(table.telemetry().locks, config.concurrency);
+    if (table.stats().stripes.empty())
+    {
+        EXPECT_EQ(advice.config.concurrency, config.concurrency);
+    }
+    EXPECT_GT(advice.predicted_probe_length, 1.0);
+    EXPECT_FALSE(omega::format_advice(advice, config).empty());
+
+    omega::concurrent_lookup_table<int, int> advised(advice.config.concurrency, advice.config.capacity,
+                                                     advice.config.grow_concurrency_on_resize);
+    for (int i = 0; i < 2000; ++i)
+    {
+        advised.add_or_update(i, i);
+    }
+    EXPECT_EQ(advised.telemetry().resizes, 0);
+}
+
+namespace
+{
+struct operation_allocations
+{
+    double get_value = 0.0;
+    double update = 0.0;
+    double insert = 0.0;
+    // Per entry moved by a resize
+    double resize = 0.0;
+    // Entries, buckets and locks of a table grown from empty
+    double bytes_per_entry = 0.0;
+};
+
+template<typename Key, typename Value>
+operation_allocations count_allocations(std::vector<Key> const& keys, Value const& value)
+{
+    operation_allocations result;
+    double const count = double(keys.size());
+    omega::concurrent_lookup_table<Key, Value> table(16, 16);
+    omega::allocation_scope const table_scope;
+    omega::allocation_scope const insert_scope;
+    for (auto const& key : keys)
+    {
+        table.add_or_update(key, value);
+    }
+    omega::allocation_stats const inserts = insert_scope.counted();
+    result.bytes_per_entry = double(table_scope.counted().live_bytes()) / count;
+
+    omega::allocation_scope const get_scope;
+    for (auto const& key : keys)
+    {
+        EXPECT_TRUE(table.get_value(key));
+    }
+    result.get_value = double(get_scope.counted().allocations) / count;
+
+    omega::allocation_scope const update_scope;
+    for (auto const& key : keys)
+    {
+        table.add_or_update(key, value);
+    }
+    result.update = double(update_scope.counted().allocations) / count;
+
+    omega::concurrent_lookup_table<Key, Value> sized(16, 4 * keys.size());
+    omega::allocation_scope const sized_scope;
+    for (auto const& key : keys)
+    {
+        sized.add_or_update(key, value);
+    }
+    result.insert = double(sized_scope.counted().allocations) / count;
+
+    std::uint64_t const moved = table.telemetry().entries_moved;
+    omega::allocation_scope const resize_scope;
+    table.reserve(4 * table.telemetry().buckets);
+    result.resize = double(resize_scope.counted().allocations) / double(table.telemetry().entries_moved - moved);
+    EXPECT_GT(inserts.allocations, 0);
+    return result;
+}
+}
+
+// Budgets of the hot path, an extra allocation per operation fails here
+TEST(LookupTable, AllocationsPerOperation)
+{
+    constexpr int entries = 4096;
+    std::vector<int> int_keys;
+    std::vector<std::string> string_keys;
+    for (int i = 0; i < entries; ++i)
+    {
+        int_keys.push_back(i);
+        string_keys.push_back("a key longer than the small string buffer " + std::to_string(i));
+    }
+    std::string const value(32, 'v');
+
+    operation_allocations const ints = count_allocations(int_keys, 1);
+    EXPECT_EQ(ints.get_value, 0.0);
+    EXPECT_EQ(ints.update, 0.0);
+    EXPECT_EQ(ints.insert, 1.0);
+    EXPECT_LE(ints.resize, 1.01);
+
+    // get_value copies the value into the returned std::optional
+    operation_allocations const strings = count_allocations(int_keys, value);
+    EXPECT_EQ(strings.get_value, 1.0);
+    EXPECT_EQ(strings.update, 0.0);
+    EXPECT_EQ(strings.insert, 2.0);
+    EXPECT_LE(strings.resize, 2.01);
+
+    operation_allocations const string_pairs = count_allocations(string_keys, value);
+    EXPECT_EQ(string_pairs.get_value, 1.0);
+    EXPECT_EQ(string_pairs.update, 0.0);
+    EXPECT_EQ(string_pairs.insert, 3.0);
+    EXPECT_LE(string_pairs.resize, 3.01);
+
+    // Lock statistics add a cache line of counters per stripe of the table and of every table it replaced
+#ifndef OMEGA_LOCK_STATS
+    EXPECT_LE(ints.bytes_per_entry, 48.0);
+    EXPECT_LE(strings.bytes_per_entry, 128.0);
+    EXPECT_LE(string_pairs.bytes_per_entry, 384.0);
+#endif
+    RecordProperty("int_int_bytes_per_entry", std::to_string(ints.bytes_per_entry));
+    RecordProperty("int_string_bytes_per_entry", std::to_string(strings.bytes_per_entry));
+    RecordProperty("string_string_bytes_per_entry", std::to_string(string_pairs.bytes_per_entry));
+}
+
+static_assert(sizeof(omega::adaptive_mutex) == 64, "one stripe mutex per cache line");
+static_assert(sizeof(omega::mcs_mutex) == 64, "one stripe mutex per cache line");
+
+// Every stripe mutex the table may be instantiated with
+template<typename Mutex>
+class LookupTableMutex : public testing::Test
+{};
+
+using stripe_mutex_types = testing::Types<std::mutex, omega::adaptive_mutex, omega::mcs_mutex>;
+TYPED_TEST_SUITE(LookupTableMutex, stripe_mutex_types);
+
+TYPED_TEST(LookupTableMutex, GuardsStripes)
+{
+    using table_type = omega::concurrent_lookup_table<int, int, 4, std::hash<int>, omega::null_tracer, TypeParam>;
+
+    TypeParam mutex;
+    EXPECT_TRUE(mutex.try_lock());
+    EXPECT_FALSE(mutex.try_lock());
+    mutex.unlock();
+
+    constexpr int threads_count = 4;
+    constexpr int increments = 20000;
+    table_type table(2, 2);
+    for (int key = 0; key < 4; ++key)
+    {
+        table.add_or_update(key, 0);
+    }
+
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < threads_count; ++thread)
+    {
+        threads.emplace_back([&table, thread]
+        {
+            for (int i = 0; i < increments; ++i)
+            {
+                table.visit(i % 4, [](int& value) { ++value; });
+                // Growing the table takes every stripe mutex through multiple_lock
+                table.add_or_update(1000 + thread * increments + i, i);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    int total = 0;
+    for (int key = 0; key < 4; ++key)
+    {
+        total += table.get_value(key).value();
+    }
+    EXPECT_EQ(total, threads_count * increments);
+    EXPECT_EQ(table.telemetry().entries, 4 + threads_count * increments);
+    EXPECT_GT(table.telemetry().resizes, 0);
+}
+
+TEST(LookupTable, McsMutexHandsOverInArrivalOrder)
+{
+    constexpr int waiters_count = 6;
+    omega::mcs_mutex mutex;
+    std::vector<int> order;
+    std::vector<std::thread> waiters;
+    std::atomic<int> started{0};
+
+    mutex.lock();
+    for (int waiter = 0; waiter < waiters_count; ++waiter)
+    {
+        waiters.emplace_back([&mutex, &order, &started, waiter]
+        {
+            started.fetch_add(1);
+            mutex.lock();
+            order.push_back(waiter);
+            mutex.unlock();
+        });
+        // Queue the waiters one after the other while the lock stays held
+        while (started.load() == waiter)
+        {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    mutex.unlock();
+    for (auto& waiter : waiters)
+    {
+        waiter.join();
+    }
+
+    std::vector<int> expected(waiters_count);
+    for (int waiter = 0; waiter < waiters_count; ++waiter)
+    {
+        expected[waiter] = waiter;
+    }
+    EXPECT_EQ(order, expected);
+}
+
 int main(int argc, char* argv[])
 {
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,353 @@
+#include "concurrent_lookup_table.h"
+#include "config_advisor.h"
+#include "latency_histogram.h"
+#include "workload_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+struct driver_options
+{
+    std::string trace;
+    std::size_t concurrency = 256;
+    std::size_t capacity = 256;
+    bool grow_concurrency = true;
+    std::size_t max_load_factor = 4;
+    // Prints recommended settings collected from the replay
+    bool advise = false;
+    // Replays the trace over a grid of settings including the recommended ones
+    bool sweep = false;
+    // Keeps the recorded order of the records on each key across threads, otherwise every thread replays its own
+    // records at full speed
+    bool ordered = true;
+};
+
+// MaxLoadFactor is a template argument, only these instantiations are compiled in
+bool is_supported_load_factor(std::size_t max_load_factor)
+{
+    return max_load_factor == 2 || max_load_factor == 4 || max_load_factor == 8;
+}
+
+driver_options parse_options(int argc, char* argv[])
+{
+    std::map<std::string, std::string> arguments;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const argument = argv[i];
+        std::size_t const separator = argument.find('=');
+        if (argument.compare(0, 2, "--") != 0 || separator == std::string::npos)
+            throw std::invalid_argument("expected --name=value, got " + argument);
+        arguments[argument.substr(2, separator - 2)] = argument.substr(separator + 1);
+    }
+
+    driver_options options;
+    for (auto const& [name, value] : arguments)
+    {
+        if (name == "trace")
+            options.trace = value;
+        else if (name == "concurrency")
+            options.concurrency = std::stoull(value);
+        else if (name == "capacity")
+            options.capacity = std::stoull(value);
+        else if (name == "grow_concurrency")
+            options.grow_concurrency = value != "0";
+        else if (name == "max_load_factor")
+            options.max_load_factor = std::stoull(value);
+        else if (name == "advise")
+            options.advise = value != "0";
+        else if (name == "sweep")
+            options.sweep = value != "0";
+        else if (name == "order" && (value == "recorded" || value == "free"))
+            options.ordered = value == "recorded";
+        else
+            throw std::invalid_argument("unknown option --" + name + "=" + value);
+    }
+
+    if (options.trace.empty() || options.concurrency == 0)
+        throw std::invalid_argument("--trace is required and concurrency must be positive");
+    if (!is_supported_load_factor(options.max_load_factor))
+        throw std::invalid_argument("--max_load_factor must be 2, 4 or 8");
+    return options;
+}
+
+constexpr std::size_t OPERATION_TYPES = 3;
+constexpr char const* operation_names[OPERATION_TYPES] = {"get_value", "add_or_update", "remove"};
+
+struct thread_result
+{
+    omega::latency_histogram latencies[OPERATION_TYPES];
+};
+
+constexpr std::size_t NO_PREDECESSOR = std::numeric_limits<std::size_t>::max();
+
+// Replays the records with the given positions in the trace, in the order the thread recorded them. In recorded
+// order a record also waits until the previous record on its key ran, when another thread recorded that one.
+// Records on different keys run concurrently, so the replay contends like the recording did while every key
+// sees the same sequence of operations. Predecessors come earlier in the trace, the waits cannot deadlock
+template<typename Table>
+void replay(Table& table, omega::workload_trace const& trace, std::vector<std::size_t> const& positions,
+            std::vector<std::size_t> const& predecessors, std::unordered_map<std::uint32_t, std::string> const& values,
+            std::atomic<bool>* executed, thread_result& result)
+{
+    for (std::size_t position : positions)
+    {
+        omega::trace_record const& record = trace.records[position];
+        if (executed && predecessors[position] != NO_PREDECESSOR)
+        {
+            while (!executed[predecessors[position]].load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        switch (record.operation)
+        {
+        case omega::trace_operation::get_value:
+            table.get_value(record.key);
+            break;
+        case omega::trace_operation::add_or_update:
+            table.add_or_update(record.key, values.at(record.value_size));
+            break;
+        case omega::trace_operation::remove:
+            table.remove(record.key);
+            break;
+        }
+        auto const finish = std::chrono::steady_clock::now();
+
+        if (executed)
+            executed[position].store(true, std::memory_order_release);
+        result.latencies[std::size_t(record.operation) - 1].record(
+            std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count()));
+    }
+}
+
+struct prepared_trace
+{
+    omega::workload_trace trace;
+    std::vector<std::vector<std::size_t>> positions;
+    // Previous record on the same key when a different thread recorded it, NO_PREDECESSOR otherwise
+    std::vector<std::size_t> predecessors;
+    std::unordered_map<std::uint32_t, std::string> values;
+    // Most keys present at once when the records run in trace order
+    std::size_t peak_entries = 0;
+};
+
+prepared_trace prepare(std::string const& path)
+{
+    prepared_trace prepared;
+    prepared.trace = omega::read_trace(path);
+    std::unordered_set<std::uint64_t> present;
+    std::unordered_map<std::uint64_t, std::size_t> last_record;
+    prepared.predecessors.resize(prepared.trace.records.size(), NO_PREDECESSOR);
+    for (std::size_t i = 0; i < prepared.trace.records.size(); ++i)
+    {
+        omega::trace_record const& record = prepared.trace.records[i];
+        if (std::size_t(record.operation) - 1 >= OPERATION_TYPES)
+            throw std::runtime_error("unknown operation in trace record " + std::to_string(i));
+        if (record.thread >= prepared.positions.size())
+            prepared.positions.resize(record.thread + 1);
+        prepared.positions[record.thread].push_back(i);
+        auto const last = last_record.find(record.key);
+        if (last != last_record.end() && prepared.trace.records[last->second].thread != record.thread)
+            prepared.predecessors[i] = last->second;
+        last_record[record.key] = i;
+        if (record.operation == omega::trace_operation::add_or_update)
+        {
+            if (prepared.values.count(record.value_size) == 0)
+                prepared.values.emplace(record.value_size, std::string(record.value_size, 'v'));
+            present.insert(record.key);
+            prepared.peak_entries = std::max(prepared.peak_entries, present.size());
+        }
+        else if (record.operation == omega::trace_operation::remove)
+        {
+            present.erase(record.key);
+        }
+    }
+    return prepared;
+}
+
+struct run_result
+{
+    double seconds = 0.0;
+    omega::latency_histogram latencies[OPERATION_TYPES];
+    omega::table_observation observation;
+};
+
+template<std::size_t MaxLoadFactor>
+run_result run(prepared_trace const& prepared, omega::table_config const& config, bool ordered)
+{
+    using table_type = omega::concurrent_lookup_table<std::uint64_t, std::string, MaxLoadFactor>;
+    table_type table(config.concurrency, config.capacity, config.grow_concurrency_on_resize);
+    table.enable_metrics();
+
+    std::unique_ptr<std::atomic<bool>[]> executed;
+    if (ordered)
+        executed.reset(new std::atomic<bool>[prepared.trace.records.size()]{});
+    std::vector<thread_result> results(prepared.positions.size());
+    std::vector<std::thread> threads;
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < prepared.positions.size(); ++i)
+    {
+        threads.emplace_back(replay<table_type>, std::ref(table), std::cref(prepared.trace), std::cref(prepared.positions[i]),
+                             std::cref(prepared.predecessors), std::cref(prepared.values), executed.get(), std::ref(results[i]));
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    run_result result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto const& thread : results)
+    {
+        for (std::size_t operation = 0; operation < OPERATION_TYPES; ++operation)
+        {
+            result.latencies[operation].merge(thread.latencies[operation]);
+        }
+    }
+    result.observation = omega::observe(table, config, prepared.peak_entries);
+    return result;
+}
+
+run_result run(prepared_trace const& prepared, omega::table_config const& config, bool ordered)
+{
+    switch (config.max_load_factor)
+    {
+    case 2:
+        return run<2>(prepared, config, ordered);
+    case 8:
+        return run<8>(prepared, config, ordered);
+    default:
+        return run<4>(prepared, config, ordered);
+    }
+}
+
+void print_latencies(run_result const& result)
+{
+    std::printf("%-18s %12s %10s %10s %10s %10s %10s %12s\n", "operation", "count", "mean ns", "p50 ns", "p95 ns",
+                "p99 ns", "p99.9 ns", "max ns");
+    for (std::size_t operation = 0; operation < OPERATION_TYPES; ++operation)
+    {
+        omega::latency_histogram const& latencies = result.latencies[operation];
+        if (latencies.count() == 0)
+            continue;
+
+        std::printf("%-18s %12llu %10.0f %10llu %10llu %10llu %10llu %12llu\n", operation_names[operation],
+                    static_cast<unsigned long long>(latencies.count()), latencies.mean(),
+                    static_cast<unsigned long long>(latencies.percentile(50)),
+                    static_cast<unsigned long long>(latencies.percentile(95)),
+                    static_cast<unsigned long long>(latencies.percentile(99)),
+                    static_cast<unsigned long long>(latencies.percentile(99.9)),
+                    static_cast<unsigned long long>(latencies.max()));
+    }
+}
+
+// Replays every configuration of the grid and prints one row each, the recommended one last
+void sweep(prepared_trace const& prepared, driver_options const& options, omega::table_config const& advised)
+{
+    std::vector<omega::table_config> grid;
+    for (std::size_t max_load_factor : {2, 4, 8})
+    {
+        // The given capacity and the one reserve() picks for the peak entries
+        for (std::size_t capacity : {options.capacity,
+                                     omega::reserve_capacity(prepared.peak_entries, max_load_factor)})
+        {
+            for (std::size_t concurrency : {16, 64, 256, 1024})
+            {
+                grid.push_back({concurrency, capacity, options.grow_concurrency, max_load_factor});
+            }
+        }
+    }
+    grid.push_back(advised);
+
+    std::printf("%-12s %10s %6s %6s %14s %10s %10s\n", "concurrency", "capacity", "grow", "load", "ops/s", "p99 ns",
+                "resizes");
+    double best = 0.0;
+    double recommended = 0.0;
+    std::size_t best_row = 0;
+    for (std::size_t row = 0; row < grid.size(); ++row)
+    {
+        omega::table_config const& config = grid[row];
+        run_result const result = run(prepared, config, options.ordered);
+        omega::latency_histogram latencies;
+        for (auto const& operation : result.latencies)
+        {
+            latencies.merge(operation);
+        }
+        double const throughput = double(prepared.trace.records.size()) / result.seconds;
+        if (throughput > best)
+        {
+            best = throughput;
+            best_row = row;
+        }
+        recommended = throughput;
+        std::printf("%-12zu %10zu %6d %6zu %14.0f %10llu %10llu%s\n", config.concurrency, config.capacity,
+                    int(config.grow_concurrency_on_resize), config.max_load_factor, throughput,
+                    static_cast<unsigned long long>(latencies.percentile(99)),
+                    static_cast<unsigned long long>(result.observation.telemetry.resizes),
+                    row + 1 == grid.size() ? "  recommended" : "");
+    }
+    std::printf("fastest: row %zu, recommended runs at %.0f%% of it\n", best_row + 1, 100.0 * recommended / best);
+}
+}
+
+// Re-executes a trace written by omega::trace_recorder against a table configured by the options, one thread
+// per recorded thread. Keys are the recorded keys or key hashes, values are strings of the recorded size.
+// --advise=1 prints settings recommended by omega::advise for the replay, --sweep=1 also replays them and a
+// grid of other settings to validate the recommendation.
+// Options: --trace=path --concurrency=mutexes --capacity=buckets --grow_concurrency=0|1 --max_load_factor=2|4|8
+//          --order=recorded|free --advise=0|1 --sweep=0|1
+int main(int argc, char* argv[])
+{
+    try
+    {
+        driver_options const options = parse_options(argc, argv);
+        prepared_trace const prepared = prepare(options.trace);
+        omega::table_config const config{options.concurrency, options.capacity, options.grow_concurrency,
+                                         options.max_load_factor};
+        run_result const result = run(prepared, config, options.ordered);
+
+        std::printf("%zu records(%llu dropped while recording%s), %zu threads, %s order: %.0f ops/s\n",
+                    prepared.trace.records.size(), static_cast<unsigned long long>(prepared.trace.header.dropped),
+                    prepared.trace.header.flags & omega::TRACE_EXACT_KEYS ? "" : ", keys are hashes",
+                    prepared.positions.size(), options.ordered ? "recorded" : "free",
+                    double(prepared.trace.records.size()) / result.seconds);
+        print_latencies(result);
+
+        if (options.advise || options.sweep)
+        {
+            omega::config_advice const advice = omega::advise(result.observation);
+            std::printf("\n%s", omega::format_advice(advice, config).c_str());
+            if (options.sweep)
+            {
+                std::printf("\n");
+                sweep(prepared, options, advice.config);
+            }
+        }
+    }
+    catch (std::exception const& error)
+    {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace omega
+{
+// Key distributions and operation mixes of the Yahoo! Cloud Serving Benchmark. Generators
+// return item numbers in [0, items), items grows as the workload inserts new records
+enum class key_distribution
+{
+    uniform,
+    zipfian,
+    scrambled_zipfian,
+    latest,
+    hotspot
+};
+
+inline key_distribution parse_key_distribution(std::string const& name)
+{
+    if (name == "uniform")
+        return key_distribution::uniform;
+    if (name == "zipfian")
+        return key_distribution::zipfian;
+    if (name == "scrambled")
+        return key_distribution::scrambled_zipfian;
+    if (name == "latest")
+        return key_distribution::latest;
+    if (name == "hotspot")
+        return key_distribution::hotspot;
+    throw std::invalid_argument("unknown key distribution " + name);
+}
+
+inline std::uint64_t fnv_hash64(std::uint64_t value)
+{
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (int i = 0; i < 8; ++i)
+    {
+        hash ^= value & 0xFF;
+        hash *= 0x100000001B3ull;
+        value >>= 8;
+    }
+
+    return hash;
+}
+
+// Zipfian distribution over [0, items) with item 0 the most popular one(Gray et al., "Quickly
+// generating billion-record synthetic databases"). zeta(items) is extended incrementally when items grows
+class zipfian_generator
+{
+    double m_theta;
+    double m_alpha;
+    double m_zeta2;
+    std::uint64_t m_items = 0;
+    double m_zetan = 0.0;
+    double m_eta = 0.0;
+
+    void grow(std::uint64_t items)
+    {
+        for (std::uint64_t i = m_items; i < items; ++i)
+        {
+            m_zetan += 1.0 / std::pow(double(i + 1), m_theta);
+        }
+        m_items = items;
+        update_eta();
+    }
+
+    void update_eta()
+    {
+        m_eta = (1.0 - std::pow(2.0 / double(m_items), 1.0 - m_theta)) / (1.0 - m_zeta2 / m_zetan);
+    }
+
+public:
+    constexpr static double DEFAULT_THETA = 0.99;
+
+    explicit zipfian_generator(double theta = DEFAULT_THETA)
+        : m_theta{theta}
+        , m_alpha{1.0 / (1.0 - theta)}
+        , m_zeta2{1.0 + 1.0 / std::pow(2.0, theta)}
+    {}
+
+    // Skips the zeta computation for a known item count, see zeta()
+    zipfian_generator(std::uint64_t items, double zetan, double theta = DEFAULT_THETA)
+        : zipfian_generator{theta}
+    {
+        m_items = items;
+        m_zetan = zetan;
+        update_eta();
+    }
+
+    // zeta(items) = sum of 1 / i^theta for i in [1, items], it takes time linear in items
+    static double zeta(std::uint64_t items, double theta = DEFAULT_THETA)
+    {
+        double zetan = 0.0;
+        for (std::uint64_t i = 0; i < items; ++i)
+        {
+            zetan += 1.0 / std::pow(double(i + 1), theta);
+        }
+        return zetan;
+    }
+
+    template<typename Random>
+    std::uint64_t next(Random& random, std::uint64_t items)
+    {
+        if (items > m_items)
+            grow(items);
+
+        double const u = std::uniform_real_distribution<double>{}(random);
+        double const uz = u * m_zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, m_theta))
+            return std::min<std::uint64_t>(1, items - 1);
+        return std::min(items - 1, std::uint64_t(double(m_items) * std::pow(m_eta * u - m_eta + 1.0, m_alpha)));
+    }
+};
+
+// Popular items are spread over the key space by hashing, as in YCSB the zipfian draw is made
+// over a fixed large item count whose zeta constant is precomputed
+class scrambled_zipfian_generator
+{
+    constexpr static std::uint64_t ITEM_COUNT = 10000000000ull;
+    constexpr static double ZETAN = 26.46902820178302;
+
+    zipfian_generator m_zipfian{ITEM_COUNT, ZETAN};
+
+public:
+    template<typename Random>
+    std::uint64_t next(Random& random, std::uint64_t items)
+    {
+        return fnv_hash64(m_zipfian.next(random, ITEM_COUNT)) % items;
+    }
+};
+
+// The most recently inserted items are the most popular ones
+class latest_generator
+{
+    zipfian_generator m_zipfian;
+
+public:
+    latest_generator()=default;
+
+    explicit latest_generator(zipfian_generator const& zipfian)
+        : m_zipfian{zipfian}
+    {}
+
+    template<typename Random>
+    std::uint64_t next(Random& random, std::uint64_t items)
+    {
+        return items - 1 - m_zipfian.next(random, items);
+    }
+};
+
+// hot_operations of the operations go to the first hot_fraction of the items, uniformly within each set
+class hotspot_generator
+{
+    double m_hot_fraction;
+    double m_hot_operations;
+
+public:
+    explicit hotspot_generator(double hot_fraction = 0.2, double hot_operations = 0.8)
+        : m_hot_fraction{hot_fraction}
+        , m_hot_operations{hot_operations}
+    {}
+
+    template<typename Random>
+    std::uint64_t next(Random& random, std::uint64_t items)
+    {
+        std::uint64_t const hot_items = std::max<std::uint64_t>(1, std::uint64_t(double(items) * m_hot_fraction));
+        if (std::uniform_real_distribution<double>{}(random) < m_hot_operations || hot_items == items)
+            return std::uniform_int_distribution<std::uint64_t>{0, hot_items - 1}(random);
+        return std::uniform_int_distribution<std::uint64_t>{hot_items, items - 1}(random);
+    }
+};
+
+class key_generator
+{
+    key_distribution m_distribution;
+    zipfian_generator m_zipfian;
+    scrambled_zipfian_generator m_scrambled;
+    latest_generator m_latest;
+    hotspot_generator m_hotspot;
+
+public:
+    explicit key_generator(key_distribution distribution)
+        : m_distribution{distribution}
+    {}
+
+    // Starts the zipfian draws at items with zetan = zipfian_generator::zeta(items), so computing it
+    // can happen once up front instead of in the first draw
+    key_generator(key_distribution distribution, std::uint64_t items, double zetan)
+        : m_distribution{distribution}
+        , m_zipfian{items, zetan}
+        , m_latest{zipfian_generator{items, zetan}}
+    {}
+
+    template<typename Random>
+    std::uint64_t next(Random& random, std::uint64_t items)
+    {
+        switch (m_distribution)
+        {
+        case key_distribution::zipfian:
+            return m_zipfian.next(random, items);
+        case key_distribution::scrambled_zipfian:
+            return m_scrambled.next(random, items);
+        case key_distribution::latest:
+            return m_latest.next(random, items);
+        case key_distribution::hotspot:
+            return m_hotspot.next(random, items);
+        case key_distribution::uniform:
+            break;
+        }
+
+        return std::uniform_int_distribution<std::uint64_t>{0, items - 1}(random);
+    }
+};
+
+enum class operation_type
+{
+    read,
+    update,
+    insert,
+    scan,
+    read_modify_write
+};
+
+constexpr std::size_t OPERATION_TYPES = 5;
+
+inline char const* operation_name(operation_type operation)
+{
+    constexpr char const* names[OPERATION_TYPES] = {"read", "update", "insert", "scan", "read_modify_write"};
+    return names[std::size_t(operation)];
+}
+
+// Operation proportions, they are normalized by choose()
+struct workload_mix
+{
+    double proportions[OPERATION_TYPES];
+    key_distribution distribution;
+
+    template<typename Random>
+    operation_type choose(Random& random) const
+    {
+        double total = 0.0;
+        for (double proportion : proportions)
+        {
+            total += proportion;
+        }
+
+        double point = std::uniform_real_distribution<double>{0.0, total}(random);
+        std::size_t last = 0;
+        for (std::size_t i = 0; i < OPERATION_TYPES; ++i)
+        {
+            if (proportions[i] <= 0.0)
+                continue;
+            if (point < proportions[i])
+                return operation_type(i);
+            point -= proportions[i];
+            last = i;
+        }
+
+        // Rounding may leave a tiny remainder
+        return operation_type(last);
+    }
+};
+
+// YCSB core workloads A-F
+inline workload_mix ycsb_workload(char name)
+{
+    switch (name)
+    {
+    case 'A':
+        return workload_mix{{0.5, 0.5, 0.0, 0.0, 0.0}, key_distribution::zipfian};
+    case 'B':
+        return workload_mix{{0.95, 0.05, 0.0, 0.0, 0.0}, key_distribution::zipfian};
+    case 'C':
+        return workload_mix{{1.0, 0.0, 0.0, 0.0, 0.0}, key_distribution::zipfian};
+    case 'D':
+        return workload_mix{{0.95, 0.0, 0.05, 0.0, 0.0}, key_distribution::latest};
+    case 'E':
+        return workload_mix{{0.0, 0.0, 0.05, 0.95, 0.0}, key_distribution::zipfian};
+    case 'F':
+        return workload_mix{{0.5, 0.0, 0.0, 0.0, 0.5}, key_distribution::zipfian};
+    }
+
+    throw std::invalid_argument(std::string("unknown YCSB workload ") + name);
+}
+}
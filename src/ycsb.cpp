@@ -0,0 +1,215 @@
+#include "concurrent_lookup_table.h"
+#include "latency_histogram.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct driver_options
+{
+    char workload = 'A';
+    std::string distribution;
+    std::uint64_t records = 1000000;
+    std::uint64_t operations = 1000000;
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t value_size = 100;
+    std::size_t concurrency = 256;
+    std::size_t max_scan_length = 100;
+    // Operations of the run phase are written here as a trace for trace_replay
+    std::string record_trace;
+};
+
+driver_options parse_options(int argc, char* argv[])
+{
+    std::map<std::string, std::string> arguments;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const argument = argv[i];
+        std::size_t const separator = argument.find('=');
+        if (argument.compare(0, 2, "--") != 0 || separator == std::string::npos)
+            throw std::invalid_argument("expected --name=value, got " + argument);
+        arguments[argument.substr(2, separator - 2)] = argument.substr(separator + 1);
+    }
+
+    driver_options options;
+    for (auto const& [name, value] : arguments)
+    {
+        if (name == "workload" && value.size() == 1)
+            options.workload = value[0];
+        else if (name == "distribution")
+            options.distribution = value;
+        else if (name == "records")
+            options.records = std::stoull(value);
+        else if (name == "operations")
+            options.operations = std::stoull(value);
+        else if (name == "threads")
+            options.threads = std::stoull(value);
+        else if (name == "value_size")
+            options.value_size = std::stoull(value);
+        else if (name == "concurrency")
+            options.concurrency = std::stoull(value);
+        else if (name == "max_scan_length")
+            options.max_scan_length = std::stoull(value);
+        else if (name == "record_trace")
+            options.record_trace = value;
+        else
+            throw std::invalid_argument("unknown option --" + name);
+    }
+
+    if (options.records == 0 || options.threads == 0 || options.max_scan_length == 0)
+        throw std::invalid_argument("records, threads and max_scan_length must be positive");
+    return options;
+}
+
+using table_type = omega::concurrent_lookup_table<std::uint64_t, std::string>;
+
+struct thread_result
+{
+    omega::latency_histogram latencies[omega::OPERATION_TYPES];
+};
+
+// Item numbers are used as keys, the hash function decides how popular items map to stripes.
+// zetan is the zipfian zeta of the loaded records, computed before the timed run
+void run_operations(table_type& table, omega::workload_mix const& mix, driver_options const& options,
+                    double zetan, std::atomic<std::uint64_t>& next_item, std::uint64_t operations,
+                    std::size_t seed, thread_result& result)
+{
+    std::mt19937_64 random{seed};
+    omega::key_generator keys{mix.distribution, options.records, zetan};
+    std::string const value(options.value_size, 'v');
+    for (std::uint64_t i = 0; i < operations; ++i)
+    {
+        omega::operation_type const operation = mix.choose(random);
+        std::uint64_t const items = next_item.load(std::memory_order_relaxed);
+        auto const start = std::chrono::steady_clock::now();
+        switch (operation)
+        {
+        case omega::operation_type::read:
+            table.get_value(keys.next(random, items));
+            break;
+        case omega::operation_type::update:
+            table.add_or_update(keys.next(random, items), value);
+            break;
+        case omega::operation_type::insert:
+            table.add_or_update(next_item.fetch_add(1, std::memory_order_relaxed), value);
+            break;
+        case omega::operation_type::scan:
+        {
+            // A hash table has no key order, a scan reads a run of consecutive item numbers
+            std::uint64_t const first = keys.next(random, items);
+            std::uint64_t const length = std::uniform_int_distribution<std::uint64_t>{1, options.max_scan_length}(random);
+            for (std::uint64_t item = first; item < first + length && item < items; ++item)
+            {
+                table.get_value(item);
+            }
+            break;
+        }
+        case omega::operation_type::read_modify_write:
+        {
+            std::uint64_t const key = keys.next(random, items);
+            auto current = table.get_value(key);
+            table.add_or_update(key, current ? *current : value);
+            break;
+        }
+        }
+        auto const finish = std::chrono::steady_clock::now();
+        result.latencies[std::size_t(operation)].record(
+            std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count()));
+    }
+}
+}
+
+// Loads records entries, then runs a YCSB core workload and prints throughput and latency percentiles per operation.
+// Options: --workload=A..F --distribution=uniform|zipfian|scrambled|latest|hotspot --records=N --operations=N
+// --threads=N --value_size=bytes --concurrency=mutexes --max_scan_length=N --record_trace=path
+int main(int argc, char* argv[])
+{
+    try
+    {
+        driver_options const options = parse_options(argc, argv);
+        omega::workload_mix mix = omega::ycsb_workload(options.workload);
+        if (!options.distribution.empty())
+            mix.distribution = omega::parse_key_distribution(options.distribution);
+
+        table_type table(options.concurrency, options.concurrency);
+        table.reserve(options.records);
+        std::string const value(options.value_size, 'v');
+        for (std::uint64_t i = 0; i < options.records; ++i)
+        {
+            table.add_or_update(i, value);
+        }
+
+        std::shared_ptr<omega::trace_recorder<std::uint64_t, std::string>> trace;
+        if (!options.record_trace.empty())
+        {
+            trace = std::make_shared<omega::trace_recorder<std::uint64_t, std::string>>();
+            table.attach_trace(trace);
+        }
+
+        double const zetan = omega::zipfian_generator::zeta(options.records);
+        std::atomic<std::uint64_t> next_item{options.records};
+        std::vector<thread_result> results(options.threads);
+        std::vector<std::thread> threads;
+        auto const start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < options.threads; ++i)
+        {
+            std::uint64_t const operations = options.operations / options.threads + (i < options.operations % options.threads);
+            threads.emplace_back(run_operations, std::ref(table), std::cref(mix), std::cref(options), zetan, std::ref(next_item),
+                                 operations, i + 1, std::ref(results[i]));
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (trace)
+            trace->save(options.record_trace);
+
+        std::printf("workload %c, %llu records, %llu operations, %zu threads: %.0f ops/s\n", options.workload,
+                    static_cast<unsigned long long>(options.records), static_cast<unsigned long long>(options.operations),
+                    options.threads, double(options.operations) / seconds);
+        std::printf("%-18s %12s %12s %10s %10s %10s %10s %10s %12s\n", "operation", "count", "ops/s", "mean ns",
+                    "p50 ns", "p95 ns", "p99 ns", "p99.9 ns", "max ns");
+        for (std::size_t operation = 0; operation < omega::OPERATION_TYPES; ++operation)
+        {
+            omega::latency_histogram latencies;
+            for (auto const& result : results)
+            {
+                latencies.merge(result.latencies[operation]);
+            }
+            if (latencies.count() == 0)
+                continue;
+
+            std::printf("%-18s %12llu %12.0f %10.0f %10llu %10llu %10llu %10llu %12llu\n",
+                        omega::operation_name(omega::operation_type(operation)),
+                        static_cast<unsigned long long>(latencies.count()), double(latencies.count()) / seconds,
+                        latencies.mean(), static_cast<unsigned long long>(latencies.percentile(50)),
+                        static_cast<unsigned long long>(latencies.percentile(95)),
+                        static_cast<unsigned long long>(latencies.percentile(99)),
+                        static_cast<unsigned long long>(latencies.percentile(99.9)),
+                        static_cast<unsigned long long>(latencies.max()));
+        }
+    }
+    catch (std::exception const& error)
+    {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+
+    return 0;
+}